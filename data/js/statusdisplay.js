@@ -12,6 +12,50 @@ function saveTable(table, tableName) {
     console.log("Sent table %s", tableName);
 };
 
+// row components per table in the order the display has them, to tell the position of deleted and moved rows
+var tableRows = {};
+var pendingRowOps = {};
+
+function queueRowOp(tableName, op) {
+    // operations of 300 ms are sent in one message, the display writes them to flash together
+    if (pendingRowOps[tableName] == undefined) {
+        pendingRowOps[tableName] = [];
+        setTimeout(function() {
+            socket.send(JSON.stringify({method: "editTable", table: tableName, ops: pendingRowOps[tableName]}));
+            delete pendingRowOps[tableName];
+        }, 300);
+    }
+    pendingRowOps[tableName].push(op);
+};
+
+function rowEditCallbacks(tableName, getTable) {
+    return {
+        dataLoaded: function() {
+            tableRows[tableName] = getTable().getRows();
+        },
+        rowAdded: function(row) {
+            var rows = getTable().getRows();
+            queueRowOp(tableName, {op: "insert", index: rows.indexOf(row), row: row.getData()});
+            tableRows[tableName] = rows;
+        },
+        rowDeleted: function(row) {
+            var index = tableRows[tableName].indexOf(row);
+            if (index >= 0)
+                queueRowOp(tableName, {op: "delete", index: index});
+            tableRows[tableName] = getTable().getRows();
+        },
+        rowMoved: function(row) {
+            var rows = getTable().getRows();
+            queueRowOp(tableName, {op: "move", index: tableRows[tableName].indexOf(row), to: rows.indexOf(row)});
+            tableRows[tableName] = rows;
+        },
+        cellEdited: function(cell) {
+            var row = cell.getRow();
+            queueRowOp(tableName, {op: "update", index: getTable().getRows().indexOf(row), row: row.getData()});
+        }
+    };
+};
+
 function saveConfig() {
     var formCfg = document.getElementById("formConfig");
     var inputs = document.getElementsByTagName('input');
@@ -34,11 +78,19 @@ function saveConfig() {
 function uploadConfig(id) {
     var input = document.getElementById(id);
     if (input.files.length > 0) {
-        var reader = new FileReader();
-        reader.onload = function() {
-            socket.send(JSON.stringify({method: "importCfg", filename:input.files[0].name, data: reader.result}));
-        };
-        reader.readAsText(input.files[0]);
+        // uploaded as a file, the display writes it to flash while it is received
+        var form = new FormData();
+        form.append("config", input.files[0], input.files[0].name);
+        var request = new XMLHttpRequest();
+        request.addEventListener('load', function(event) {
+            var result = JSON.parse(this.responseText);
+            if (result.success)
+                location.reload();
+            else
+                console.warn("Config import failed: %s", result.error);
+        });
+        request.open("POST", "/api/config");
+        request.send(form);
     } else {
         console.warn("No file selected");
     }
@@ -77,7 +129,7 @@ function onPageLoad() {
             console.log("Received: %s", this.responseText);
             createStatusPage(JSON.parse(this.responseText));
 
-            socket = new ReconnectingWebSocket("ws://" + location.host + ":81/ws", null, {debug: true, reconnectInterval: 3000});
+            socket = new ReconnectingWebSocket("ws://" + location.host + ":81/ws", null, {debug: true, reconnectInterval: 3000, binaryType: "arraybuffer"});
             socket.onopen = function() {
                 console.log("WebSocket connected");
             };
@@ -85,6 +137,10 @@ function onPageLoad() {
                 console.log("WebSocket.closed");
             };
             socket.onmessage = function(event) {
+                if (event.data instanceof ArrayBuffer) { // LED frames, up to 10 per second
+                    handleLedFrame(event.data);
+                    return;
+                }
                 console.log("WebSocket message received: ", event);
 
                 // create a JSON object
@@ -98,8 +154,9 @@ function onPageLoad() {
                         else
                             console.warn("No document element with id '%s'", key);
                     }
-                } else if (method === "updLeds") {
-                    updateLedTable(jsonObject.data);
+                } else if (method === "ledDevices") {
+                    ledState.devices = jsonObject.data;
+                    updateLedTable(getLedTableData());
                 } else if (method == "log") {
                     var lines = jsonObject.lines;
                     var targetDiv = document.getElementById('logDiv');
@@ -159,7 +216,7 @@ function initColMapTable() {
         return editor;
     };
 
-    coltable = new Tabulator("#colmap-table", {
+    coltable = new Tabulator("#colmap-table", Object.assign(rowEditCallbacks("colorMapping", function() { return coltable; }), {
         virtualDom: false, //disable virtual DOM rendering
         movableRows: true, //enable user movable rows
         layout: "fitDataStretch",
@@ -185,12 +242,12 @@ function initColMapTable() {
                 }, validator:"required"},
             {formatter:"buttonCross", align:"left", cellClick:function(e, cell){cell.getRow().delete()}}
         ]
-    });
+    }));
 };
 
 function initDevMapTable() {
     console.log("initDevMapTable()");
-    devtable = new Tabulator("#devmap-table", {
+    devtable = new Tabulator("#devmap-table", Object.assign(rowEditCallbacks("deviceMapping", function() { return devtable; }), {
         virtualDom: false, //disable virtual DOM rendering
         movableRows: true, //enable user movable rows
         layout: "fitDataStretch",
@@ -200,9 +257,11 @@ function initDevMapTable() {
             {title:"No", formatter:"rownum", align:"center"},
             {title:"Device", field:"device", editor:"input", validator:["required", "unique"]},
             {title:"LED", field:"led", editor:"number", editorParams:{ min:0, max:255, step:1, elementAttributes:{ maxlength:"3", }}, validator:["required", "max:255"]},
+            {title:"JSON path", field:"path", editor:"input"},
+            {title:"Debounce (ms)", field:"debounce", editor:"number", editorParams:{ min:0, max:65535, step:100 }, validator:["min:0", "max:65535"]},
             {formatter:"buttonCross", align:"left", cellClick:function(e, cell){cell.getRow().delete()}}
         ]
-    });
+    }));
 };
 
 function initLedTable() {
@@ -225,6 +284,64 @@ function initLedTable() {
     });
 };
 
+var ledState = {version: 0, colors: [], behaviors: [], devices: []};
+
+function handleLedFrame(buffer) {
+    // header: type (1 = full, 2 = delta), version, base version (uint32, little endian), number of LEDs
+    // followed by 5 bytes per LED: LED number, red, green, blue, behavior
+    var view = new DataView(buffer);
+    if (view.byteLength < 10)
+        return;
+    var type = view.getUint8(0);
+    var version = view.getUint32(1, true);
+    var count = view.getUint8(9);
+    if (type == 1 || count != ledState.colors.length) {
+        ledState.colors = new Array(count).fill(0);
+        ledState.behaviors = new Array(count).fill(0);
+    }
+    for (var pos = 10; pos + 5 <= view.byteLength; pos += 5) {
+        var led = view.getUint8(pos);
+        if (led < count) {
+            ledState.colors[led] = (view.getUint8(pos + 1) << 16) | (view.getUint8(pos + 2) << 8) | view.getUint8(pos + 3);
+            ledState.behaviors[led] = view.getUint8(pos + 4);
+        }
+    }
+    ledState.version = version;
+    var ack = new DataView(new ArrayBuffer(4));
+    ack.setUint32(0, version, true);
+    socket.send(ack.buffer);
+
+    updateLedPreview();
+    updateLedTable(getLedTableData());
+}
+
+function getLedTableData() {
+    var data = [];
+    for (var led = 0; led < ledState.colors.length; led++) {
+        if (ledState.colors[led] != 0 && ledState.behaviors[led] != 0) {
+            data.push({id: data.length, led: led, device: ledState.devices[led] || "",
+                       col: "#" + ("00000" + ledState.colors[led].toString(16).toUpperCase()).slice(-6),
+                       beh: ledState.behaviors[led]});
+        }
+    }
+    return data;
+}
+
+function updateLedPreview() {
+    var divPreview = document.getElementById("led-preview");
+    while (divPreview.children.length > ledState.colors.length)
+        divPreview.lastElementChild.remove();
+    while (divPreview.children.length < ledState.colors.length)
+        divPreview.appendChild(document.createElement("span"));
+    for (var led = 0; led < ledState.colors.length; led++) {
+        var elem = divPreview.children[led];
+        var on = ledState.behaviors[led] != 0;
+        elem.style.backgroundColor = on ? "#" + ("00000" + ledState.colors[led].toString(16)).slice(-6) : "";
+        elem.className = on ? "ledBeh" + ledState.behaviors[led] : "";
+        elem.title = (led + ": " + (ledState.devices[led] || "")).trim();
+    }
+}
+
 function updateLedTable(data) {
     var divLedTable = document.getElementById("led-table");
     var divNoLeds = document.getElementById("noLeds");
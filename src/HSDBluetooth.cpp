@@ -86,7 +86,7 @@ void HSDBluetooth::onResult(BLEAdvertisedDevice advertisedDevice) {
                     mac.replace(":", "");
                     mac.toUpperCase();
                     String topic = m_config->getMqttOutTopic("sensors/" + mac);
-                    if (m_mqtt->connected() && m_mqtt->isTopicValid(topic))
+                    if (m_mqtt->isTopicValid(topic))
                         m_mqtt->publish(topic, json);
                 }
             }
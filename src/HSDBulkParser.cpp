@@ -0,0 +1,109 @@
+#include "HSDBulkParser.hpp"
+
+// for placeholders 
+using namespace std::placeholders; 
+
+HSDBulkParser::HSDBulkParser(Callback callback) :
+    m_callback(callback),
+    m_deviceLength(0),
+    m_errors(0),
+    m_format(Format::Unknown),
+    m_inValue(false),
+    m_json(std::bind(&HSDBulkParser::onJsonToken, this, _1, _2, _3, _4)),
+    m_msgLength(0),
+    m_truncated(false)
+{
+    m_device[0] = 0;
+    m_msg[0] = 0;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDBulkParser::feed(const char* data, size_t length) {
+    for (size_t idx = 0; idx < length; idx++) {
+        char ch = data[idx];
+        if (m_format == Format::Unknown) {
+            if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n')
+                continue;
+            m_format = ch == '{' ? Format::Json : Format::Pairs;
+        }
+        if (m_format == Format::Json) {
+            if (!m_json.feed(ch)) {
+                m_errors++;
+                return; // no way to resynchronize within a broken JSON document
+            }
+        } else {
+            appendPair(ch);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDBulkParser::finish() {
+    if (m_format == Format::Json) {
+        if (!m_json.finish() && !m_json.hasError())
+            m_errors++;   // truncated document
+    } else if (m_format == Format::Pairs) {
+        emitPair();
+    }
+    return m_errors == 0;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDBulkParser::appendPair(char ch) {
+    if (ch == ';' || ch == '&' || ch == ',' || ch == '\n' || ch == '\r') {
+        emitPair();
+    } else if (ch == '=' && !m_inValue) {
+        m_inValue = true;
+    } else if ((ch == ' ' || ch == '\t') && (m_inValue ? m_msgLength : m_deviceLength) == 0) {
+        // skip leading whitespace
+    } else if (m_inValue) {
+        if (m_msgLength < HSD_BULK_TOKEN_SIZE - 1)
+            m_msg[m_msgLength++] = ch;
+        else
+            m_truncated = true;
+    } else {
+        if (m_deviceLength < HSD_BULK_TOKEN_SIZE - 1)
+            m_device[m_deviceLength++] = ch;
+        else
+            m_truncated = true;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDBulkParser::emitPair() {
+    while (m_deviceLength > 0 && (m_device[m_deviceLength - 1] == ' ' || m_device[m_deviceLength - 1] == '\t'))
+        m_deviceLength--;
+    while (m_msgLength > 0 && (m_msg[m_msgLength - 1] == ' ' || m_msg[m_msgLength - 1] == '\t'))
+        m_msgLength--;
+    m_device[m_deviceLength] = 0;
+    m_msg[m_msgLength] = 0;
+    if (m_truncated || (m_deviceLength > 0 && !m_inValue))
+        m_errors++;
+    else if (m_deviceLength > 0 && m_callback)
+        m_callback(m_device, m_msg);
+    m_deviceLength = 0;
+    m_inValue = false;
+    m_msgLength = 0;
+    m_truncated = false;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDBulkParser::onJsonToken(HSDJsonScanner::Token token, uint8_t depth, const char* text, size_t length) {
+    if (depth != 1)
+        return;   // only the members of the top level object are of interest
+    if (token == HSDJsonScanner::Token::Key) {
+        strncpy(m_device, text, HSD_BULK_TOKEN_SIZE);
+        m_device[HSD_BULK_TOKEN_SIZE - 1] = 0;
+        m_truncated = m_json.isTruncated();
+    } else if (token == HSDJsonScanner::Token::String || token == HSDJsonScanner::Token::Literal) {
+        if (m_truncated || m_json.isTruncated())
+            m_errors++;
+        else if (m_callback && !(token == HSDJsonScanner::Token::Literal && strcmp(text, "null") == 0))
+            m_callback(m_device, text);
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef HSDBULKPARSER_H
+#define HSDBULKPARSER_H
+
+#include <Arduino.h>
+#include <functional>
+
+#include "HSDJsonScanner.hpp"
+
+#define HSD_BULK_TOKEN_SIZE HSD_JSON_TOKEN_SIZE
+
+/*
+ * Streaming parser for bulk status payloads carrying many device/message pairs, either as
+ *   device1=msg1;device2=msg2 (separated by ';', '&', ',' or line breaks)
+ * or as a flat JSON object
+ *   {"device1":"msg1","device2":"msg2"}
+ * Every complete pair is reported via the callback, the payload may be fed in blocks of any size.
+ */
+class HSDBulkParser {
+public:
+    typedef std::function<void(const char* device, const char* msg)> Callback;
+
+    HSDBulkParser(Callback callback);
+
+    void   feed(const char* data, size_t length);
+    bool   finish();
+    inline size_t getErrors() const { return m_errors; }
+
+private:
+    enum class Format : uint8_t {
+        Unknown = 0,
+        Pairs,
+        Json
+    };
+
+    void appendPair(char ch);
+    void emitPair();
+    void onJsonToken(HSDJsonScanner::Token token, uint8_t depth, const char* text, size_t length);
+
+    Callback       m_callback;
+    char           m_device[HSD_BULK_TOKEN_SIZE];
+    size_t         m_deviceLength;
+    size_t         m_errors;
+    Format         m_format;
+    bool           m_inValue;
+    HSDJsonScanner m_json;
+    char           m_msg[HSD_BULK_TOKEN_SIZE];
+    size_t         m_msgLength;
+    bool           m_truncated;
+};
+
+#endif // HSDBULKPARSER_H
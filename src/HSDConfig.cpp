@@ -11,8 +11,24 @@
 #define JSON_KEY_COLORMAPPING_MSG      "message"
 #define JSON_KEY_COLORMAPPING_COLOR    "color"
 #define JSON_KEY_COLORMAPPING_BEHAVIOR "behavior"
+#define JSON_KEY_DEVICEMAPPING_DEBOUNCE "debounce"
 #define JSON_KEY_DEVICEMAPPING_DEVICE  "device"
 #define JSON_KEY_DEVICEMAPPING_LED     "led"
+#define JSON_KEY_DEVICEMAPPING_PATH    "path"
+
+#define WRITE_DELAY_MILLIS     2000  // deferred writes wait until the edits paused for this time ...
+#define WRITE_MAX_DELAY_MILLIS 10000 // ... but not longer than this after the first edit
+
+template<typename T> static bool moveEntry(vector<T*>& entries, size_t from, size_t to) {
+    if (from >= entries.size() || to >= entries.size())
+        return false;
+    T* entry = entries[from];
+    entries.erase(entries.begin() + from);
+    entries.insert(entries.begin() + to, entry);
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
 
 HSDConfig::HSDConfig() :
 #if defined HSD_BLUETOOTH_ENABLED && defined ARDUINO_ARCH_ESP32
@@ -30,6 +46,10 @@ HSDConfig::HSDConfig() :
     m_cfgHost("HomeStatusDisplay"),
     m_cfgLedBrightness(50),
     m_cfgLedDataPin(0),
+    m_cfgLedStreamPort(0),
+    m_cfgMqttLedMirror(false),
+    m_cfgMqttMaxPayload(4096),
+    m_cfgMqttPersistentSession(false),
     m_cfgMqttPort(1883),
     m_cfgNumberOfLeds(0),
 #ifdef HSD_SENSOR_ENABLED
@@ -39,8 +59,17 @@ HSDConfig::HSDConfig() :
     m_cfgSensorSonoffEnabled(false),
     m_cfgSensorAltitude(0),
     m_cfgSensorPirEnabled(false),
-    m_cfgSensorPirPin(0)
+    m_cfgSensorPirPin(0),
 #endif // HSD_SENSOR_ENABLED
+    m_cfgStatusUdpPort(0),
+    m_colorMapIndexDirty(false),
+    m_colorMapVersion(0),
+    m_configVersion(0),
+    m_deviceMapIndexDirty(false),
+    m_deviceMapVersion(0),
+    m_writeFirst(0),
+    m_writeLast(0),
+    m_writePending(false)
 {
     m_entries.push_back(new ConfigEntry(Group::Wifi, "host", "Hostname", &m_cfgHost, "[A-Za-z0-9\\-]{1,15}", "Not a valid hostname - length must between 1 and 15")); // String
     m_entries.push_back(new ConfigEntry(Group::Wifi, "SSID", "SSID", &m_cfgWifiSSID, ".{1,32}", "Length must be between 1 and 32")); // String
@@ -49,14 +78,21 @@ HSDConfig::HSDConfig() :
     m_entries.push_back(new ConfigEntry(Group::Mqtt, "port", "Port (1-65535)", &m_cfgMqttPort, "^([0-9]{1,4}|[1-5][0-9]{4}|6[0-4][0-9]{3}|65[0-4][0-9]{2}|655[0-2][0-9]|6553[0-5])$", "Not a valid port")); // Word
     m_entries.push_back(new ConfigEntry(Group::Mqtt, "user", "User name", &m_cfgMqttUser)); // String 
     m_entries.push_back(new ConfigEntry(Group::Mqtt, "password", "Password", &m_cfgMqttPassword, "", "", true)); // String
-    m_entries.push_back(new ConfigEntry(Group::Mqtt, "statusTopic", "Status topic", &m_cfgMqttStatusTopic)); // String
+    m_entries.push_back(new ConfigEntry(Group::Mqtt, "persistentSession", "Persistent session (QoS 1)", &m_cfgMqttPersistentSession)); // Bool
+    m_entries.push_back(new ConfigEntry(Group::Mqtt, "ledMirror", "Publish LED states (retained)", &m_cfgMqttLedMirror)); // Bool
+    m_entries.push_back(new ConfigEntry(Group::Mqtt, "statusTopic", "Status topics (filters with + and #, comma separated)", &m_cfgMqttStatusTopic)); // String
+    m_entries.push_back(new ConfigEntry(Group::Mqtt, "bulkDevice", "Bulk device below status topic (empty = off)", &m_cfgMqttBulkDevice)); // String
+    m_entries.push_back(new ConfigEntry(Group::Mqtt, "maxPayload", "Max. size of large messages (bytes, 0 = off)", &m_cfgMqttMaxPayload, "^([0-9]{1,4}|[1-5][0-9]{4}|6[0-4][0-9]{3}|65[0-4][0-9]{2}|655[0-2][0-9]|6553[0-5])$", "Not a valid size (0-65535)")); // Word
 #ifdef MQTT_TEST_TOPIC
     m_entries.push_back(new ConfigEntry(Group::Mqtt, "testTopic", "Test topic", &m_cfgMqttTestTopic)); // String
 #endif // MQTT_TEST_TOPIC
+    m_entries.push_back(new ConfigEntry(Group::Mqtt, "udpPort", "UDP port for direct status updates (0 = off)", &m_cfgStatusUdpPort, "^([0-9]{1,4}|[1-5][0-9]{4}|6[0-4][0-9]{3}|65[0-4][0-9]{2}|655[0-2][0-9]|6553[0-5])$", "Not a valid port")); // Word
     m_entries.push_back(new ConfigEntry(Group::Mqtt, "outTopic", "Outgoing topic", &m_cfgMqttOutTopic)); // String
     m_entries.push_back(new ConfigEntry(Group::Leds, "count", "Number of LEDs", &m_cfgNumberOfLeds, 255)); // Slider
     m_entries.push_back(new ConfigEntry(Group::Leds, "pin", "LED pin", &m_cfgLedDataPin)); // Gpio
     m_entries.push_back(new ConfigEntry(Group::Leds, "brightness", "Brightness", &m_cfgLedBrightness, 255)); // Slider
+    m_entries.push_back(new ConfigEntry(Group::Leds, "streamPort", "UDP port for DDP pixel streams (0 = off, usually 4048)", &m_cfgLedStreamPort, "^([0-9]{1,4}|[1-5][0-9]{4}|6[0-4][0-9]{3}|65[0-4][0-9]{2}|655[0-2][0-9]|6553[0-5])$", "Not a valid port")); // Word
+    m_entries.push_back(new ConfigEntry(Group::Leds, "rules", "Rules, e.g. 12 = window1 == open && alarm == armed ? alarm : ok", &m_cfgRules)); // String
     m_entries.push_back(new ConfigEntry(Group::Leds, "colorMapping", &m_cfgColorMapping)); // ColorMapping
     m_entries.push_back(new ConfigEntry(Group::Leds, "deviceMapping", &m_cfgDeviceMapping)); // DeviceMapping
 #ifdef HSD_CLOCK_ENABLED
@@ -89,6 +125,10 @@ void HSDConfig::begin() {
     Logger.log("Initializing config (%u entries) - using ArduinoJson version %s", m_entries.size(), ARDUINOJSON_VERSION);
     if (SPIFFS.begin()) {
         Logger.log("Mounted file system.");
+        if (!SPIFFS.exists(FILENAME_MAINCONFIG) && SPIFFS.exists(FILENAME_MAINCONFIG_NEW)) {
+            Logger.log("Completing interrupted replacement of %s", FILENAME_MAINCONFIG);
+            replaceConfigFile();
+        }
         readConfigFile();
     } else {
         Logger.log("Failed to mount file system");
@@ -97,9 +137,20 @@ void HSDConfig::begin() {
 
 // ---------------------------------------------------------------------------------------------------------------------
 
+bool HSDConfig::importConfigFile(const char* path) {
+    // path is a complete and validated config file
+    SPIFFS.remove(FILENAME_MAINCONFIG_NEW);
+    if (!SPIFFS.rename(path, FILENAME_MAINCONFIG_NEW) || !replaceConfigFile()) {
+        Logger.log("Failed to replace %s with %s", FILENAME_MAINCONFIG, path);
+        return false;
+    }
+    return readConfigFile();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
 bool HSDConfig::readConfigFile() {
     bool success(false);
-    String fileBuffer;
 
     Logger.printf("Reading config file %s: ", FILENAME_MAINCONFIG);
     if (SPIFFS.exists(FILENAME_MAINCONFIG)) {
@@ -107,15 +158,11 @@ bool HSDConfig::readConfigFile() {
         if (configFile) {
             size_t size = configFile.size();
             Logger.printf("file size is %u bytes\n", size);
-            char* buffer = new char[size + 1];
-            buffer[size] = 0;
-            configFile.readBytes(buffer, size);
-            fileBuffer = buffer;
-            delete[] buffer;
+
+            // parsed from the file, no copy of the whole file in RAM
+            DynamicJsonBuffer jsonBuffer(size > 4096 ? 4096 : size + 1);
+            JsonObject& root = jsonBuffer.parseObject(configFile);
             configFile.close();
-            
-            DynamicJsonBuffer jsonBuffer(fileBuffer.length() + 1);
-            JsonObject& root = jsonBuffer.parseObject(fileBuffer);
             if (root.success()) {
                 Logger.log("Config data successfully parsed.");
                 int maxLen(0), len(0);
@@ -178,13 +225,19 @@ bool HSDConfig::readConfigFile() {
                                     const JsonObject& elem = devMap.get<JsonVariant>(i).as<JsonObject>();
                                     if (elem.containsKey(JSON_KEY_DEVICEMAPPING_DEVICE) && elem.containsKey(JSON_KEY_DEVICEMAPPING_LED))
                                         entry->value.devMap->push_back(new DeviceMapping(elem[JSON_KEY_DEVICEMAPPING_DEVICE].as<String>(),
-                                                                                         elem[JSON_KEY_DEVICEMAPPING_LED].as<int>()));
+                                                                                         elem[JSON_KEY_DEVICEMAPPING_LED].as<int>(),
+                                                                                         elem.containsKey(JSON_KEY_DEVICEMAPPING_PATH) ? elem[JSON_KEY_DEVICEMAPPING_PATH].as<String>() : String(),
+                                                                                         elem[JSON_KEY_DEVICEMAPPING_DEBOUNCE].as<unsigned int>()));
                                 }
                                 break;
                             }
                         }
                     }
                 } 
+                buildColorMapIndex();
+                buildDeviceMapIndex();
+                m_configVersion++;
+                m_writePending = false; // the file replaces any unsaved edits
                 success = true;
             } else {
                 Logger.log("Could not parse config data.");
@@ -205,53 +258,21 @@ bool HSDConfig::readConfigFile() {
 // ---------------------------------------------------------------------------------------------------------------------
 
 void HSDConfig::writeConfigFile() const {
-    DynamicJsonBuffer jsonBuffer;
-    JsonObject& root = jsonBuffer.createObject();
-    Group prevGroup = Group::__Last;
-    JsonObject* json = nullptr;
-    for (size_t idx = 0; idx < m_entries.size(); idx++) {
-        const ConfigEntry* entry = m_entries[idx];
-        if (prevGroup != entry->group) {
-            prevGroup = entry->group;
-            String groupName = groupDescription(prevGroup);
-            groupName.toLowerCase();
-            json = &root.createNestedObject(groupName);
-        }
-        switch (entry->type) {
-            case DataType::Password:
-            case DataType::String: (*json)[entry->key] = *entry->value.string;  break;
-            case DataType::Bool:   (*json)[entry->key] = *entry->value.boolean; break;
-            case DataType::Gpio:
-            case DataType::Slider: (*json)[entry->key] = *entry->value.byte;    break;
-            case DataType::Word:   (*json)[entry->key] = *entry->value.word;    break;
-            case DataType::ColorMapping: {
-                JsonArray& colMapping = json->createNestedArray(entry->key);
-                for (unsigned int index = 0; index < entry->value.colMap->size(); index++) {
-                    JsonObject& colorMappingEntry = colMapping.createNestedObject(); 
-                    auto mapping = entry->value.colMap->at(index);
-                    colorMappingEntry[JSON_KEY_COLORMAPPING_MSG] = mapping->msg;
-                    colorMappingEntry[JSON_KEY_COLORMAPPING_COLOR] = mapping->color;
-                    colorMappingEntry[JSON_KEY_COLORMAPPING_BEHAVIOR] = static_cast<int>(mapping->behavior);
-                }
-                break;
-            }
-            case DataType::DeviceMapping: {
-                JsonArray& devMapping = json->createNestedArray(entry->key);
-                for (unsigned int index = 0; index < entry->value.devMap->size(); index++) {
-                    JsonObject& deviceMappingEntry = devMapping.createNestedObject(); 
-                    auto mapping = entry->value.devMap->at(index);
-                    deviceMappingEntry[JSON_KEY_DEVICEMAPPING_DEVICE] = mapping->device;
-                    deviceMappingEntry[JSON_KEY_DEVICEMAPPING_LED]  = static_cast<int>(mapping->ledNumber);
-                }
-                break;
-            }
-        }
-    }
+    m_configVersion++;
+    m_writePending = false;
     Logger.log("Writing config file %s", FILENAME_MAINCONFIG);
-    File configFile = SPIFFS.open(FILENAME_MAINCONFIG, "w+");
+    // written to a new file first, so an interrupted write leaves the old config intact
+    File configFile = SPIFFS.open(FILENAME_MAINCONFIG_NEW, "w");
     if (configFile) {
-        root.prettyPrintTo(configFile);
+        bool failed(false);
+        HSDJsonWriter json([&configFile, &failed](const char* data, size_t length) {
+            failed |= configFile.write(reinterpret_cast<const uint8_t*>(data), length) != length;
+        });
+        writeJson(json);
+        json.flush();
         configFile.close();
+        if (failed || !replaceConfigFile())
+            Logger.log("Failed to write file %s", FILENAME_MAINCONFIG);
     } else {
         Logger.log("Failed to write file, formatting file system.");
         SPIFFS.format();
@@ -262,12 +283,8 @@ void HSDConfig::writeConfigFile() const {
 // ---------------------------------------------------------------------------------------------------------------------
 
 uint8_t HSDConfig::getLedNumber(const String& deviceName) const {
-    for (size_t i = 0; i < m_cfgDeviceMapping.size(); i++) {
-        auto mapping = m_cfgDeviceMapping.at(i);
-        if (deviceName.equals(mapping->device))
-            return mapping->ledNumber;
-    }
-    return -1;
+    int index = getDeviceIndex(deviceName);
+    return index != -1 ? m_cfgDeviceMapping[index]->ledNumber : -1;
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
@@ -283,13 +300,63 @@ String HSDConfig::getDevice(int ledNumber) const {
 
 // ---------------------------------------------------------------------------------------------------------------------
 
+int HSDConfig::getDeviceIndex(const String& deviceName) const {
+    if (m_deviceMapIndex.isEmpty() || m_deviceMapIndexDirty) { // index not built (yet), fall back to linear search
+        for (size_t i = 0; i < m_cfgDeviceMapping.size(); i++)
+            if (deviceName.equals(m_cfgDeviceMapping[i]->device))
+                return i;
+        return -1;
+    }
+    int index = m_deviceMapIndex.find(deviceName);
+    return index != -1 && deviceName.equals(m_cfgDeviceMapping[index]->device) ? index : -1;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+String HSDConfig::getDevicePath(const String& deviceName) const {
+    int index = getDeviceIndex(deviceName);
+    return index != -1 ? m_cfgDeviceMapping[index]->path : "";
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
 int HSDConfig::getColorMapIndex(const String& msg) const {
-    for (unsigned int i = 0; i < m_cfgColorMapping.size(); i++) {
-        auto mapping = m_cfgColorMapping.at(i);
-        if (msg.equals(mapping->msg))
-            return i;
+    if (m_colorMapIndex.isEmpty() || m_colorMapIndexDirty) { // index not built (yet), fall back to linear search
+        for (unsigned int i = 0; i < m_cfgColorMapping.size(); i++) {
+            auto mapping = m_cfgColorMapping.at(i);
+            if (msg.equals(mapping->msg))
+                return i;
+        }
+        return -1;
     }
-    return -1;
+    int index = m_colorMapIndex.find(msg);
+    return index != -1 && msg.equals(m_cfgColorMapping[index]->msg) ? index : -1;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDConfig::buildColorMapIndex() {
+    vector<const String*> keys;
+    keys.reserve(m_cfgColorMapping.size());
+    for (auto mapping : m_cfgColorMapping)
+        keys.push_back(&mapping->msg);
+    if (!m_colorMapIndex.build(keys))
+        Logger.log("Failed to build color map index (%u entries), using linear search", keys.size());
+    m_colorMapIndexDirty = false;
+    m_colorMapVersion++;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDConfig::buildDeviceMapIndex() {
+    vector<const String*> keys;
+    keys.reserve(m_cfgDeviceMapping.size());
+    for (auto mapping : m_cfgDeviceMapping)
+        keys.push_back(&mapping->device);
+    if (!m_deviceMapIndex.build(keys))
+        Logger.log("Failed to build device map index (%u entries), using linear search", keys.size());
+    m_deviceMapIndexDirty = false;
+    m_deviceMapVersion++;
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
@@ -343,6 +410,7 @@ void HSDConfig::setColorMap(vector<ColorMapping*>& values) {
         delete e;
     m_cfgColorMapping.clear();
     m_cfgColorMapping.assign(values.begin(), values.end());
+    buildColorMapIndex();
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
@@ -352,4 +420,188 @@ void HSDConfig::setDeviceMap(vector<DeviceMapping*>& values) {
         delete e;
     m_cfgDeviceMapping.clear();    
     m_cfgDeviceMapping.assign(values.begin(), values.end());
+    buildDeviceMapIndex();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDConfig::deleteColorMapping(size_t index) {
+    if (index >= m_cfgColorMapping.size())
+        return false;
+    delete m_cfgColorMapping[index];
+    m_cfgColorMapping.erase(m_cfgColorMapping.begin() + index);
+    m_colorMapIndexDirty = true;
+    m_configVersion++;
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDConfig::deleteDeviceMapping(size_t index) {
+    if (index >= m_cfgDeviceMapping.size())
+        return false;
+    delete m_cfgDeviceMapping[index];
+    m_cfgDeviceMapping.erase(m_cfgDeviceMapping.begin() + index);
+    m_deviceMapIndexDirty = true;
+    m_configVersion++;
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDConfig::handle() {
+    if (m_writePending && (millis() - m_writeLast >= WRITE_DELAY_MILLIS || millis() - m_writeFirst >= WRITE_MAX_DELAY_MILLIS))
+        writeConfigFile();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDConfig::insertColorMapping(size_t index, const ColorMapping& mapping) {
+    if (index > m_cfgColorMapping.size())
+        return false;
+    m_cfgColorMapping.insert(m_cfgColorMapping.begin() + index, new ColorMapping(mapping));
+    m_colorMapIndexDirty = true;
+    m_configVersion++;
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDConfig::insertDeviceMapping(size_t index, const DeviceMapping& mapping) {
+    if (index > m_cfgDeviceMapping.size())
+        return false;
+    m_cfgDeviceMapping.insert(m_cfgDeviceMapping.begin() + index, new DeviceMapping(mapping));
+    m_deviceMapIndexDirty = true;
+    m_configVersion++;
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDConfig::moveColorMapping(size_t from, size_t to) {
+    if (!moveEntry(m_cfgColorMapping, from, to))
+        return false;
+    m_colorMapIndexDirty |= from != to;
+    m_configVersion++;
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDConfig::moveDeviceMapping(size_t from, size_t to) {
+    if (!moveEntry(m_cfgDeviceMapping, from, to))
+        return false;
+    m_deviceMapIndexDirty |= from != to;
+    m_configVersion++;
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDConfig::replaceConfigFile() const {
+    // SPIFFS cannot rename onto an existing file, begin() completes a replacement interrupted in between
+    SPIFFS.remove(FILENAME_MAINCONFIG);
+    return SPIFFS.rename(FILENAME_MAINCONFIG_NEW, FILENAME_MAINCONFIG);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDConfig::updateColorMapping(size_t index, const ColorMapping& mapping) {
+    // only a changed message invalidates the index
+    if (index >= m_cfgColorMapping.size())
+        return false;
+    ColorMapping* entry = m_cfgColorMapping[index];
+    m_colorMapIndexDirty |= !entry->msg.equals(mapping.msg);
+    *entry = mapping;
+    m_configVersion++;
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDConfig::updateDeviceMapping(size_t index, const DeviceMapping& mapping) {
+    // only a changed device name invalidates the index (and the tables indexed like the device mapping)
+    if (index >= m_cfgDeviceMapping.size())
+        return false;
+    DeviceMapping* entry = m_cfgDeviceMapping[index];
+    m_deviceMapIndexDirty |= !entry->device.equals(mapping.device);
+    *entry = mapping;
+    m_configVersion++;
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDConfig::updateMapIndexes() {
+    // called once after a batch of row edits
+    if (m_colorMapIndexDirty)
+        buildColorMapIndex();
+    if (m_deviceMapIndexDirty)
+        buildDeviceMapIndex();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDConfig::writeConfigFileDeferred() {
+    // edits in quick succession are written with one flash write
+    if (!m_writePending)
+        m_writeFirst = millis();
+    m_writeLast = millis();
+    m_writePending = true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDConfig::writeJson(HSDJsonWriter& json) const {
+    // the config file format, one object per group
+    Group prevGroup = Group::__Last;
+    json.beginObject();
+    for (size_t idx = 0; idx < m_entries.size(); idx++) {
+        const ConfigEntry* entry = m_entries[idx];
+        if (prevGroup != entry->group) {
+            if (prevGroup != Group::__Last)
+                json.endObject();
+            prevGroup = entry->group;
+            String groupName = groupDescription(prevGroup);
+            groupName.toLowerCase();
+            json.beginObject(groupName.c_str());
+        }
+        const char* key = entry->key.c_str();
+        switch (entry->type) {
+            case DataType::Password:
+            case DataType::String: json.addString(key, *entry->value.string);  break;
+            case DataType::Bool:   json.addBool(key, *entry->value.boolean);   break;
+            case DataType::Gpio:
+            case DataType::Slider: json.addNumber(key, *entry->value.byte);    break;
+            case DataType::Word:   json.addNumber(key, *entry->value.word);    break;
+            case DataType::ColorMapping:
+                json.beginArray(key);
+                for (const ColorMapping* mapping : *entry->value.colMap) {
+                    json.beginObject();
+                    json.addString(JSON_KEY_COLORMAPPING_MSG, mapping->msg);
+                    json.addNumber(JSON_KEY_COLORMAPPING_COLOR, mapping->color);
+                    json.addNumber(JSON_KEY_COLORMAPPING_BEHAVIOR, static_cast<int>(mapping->behavior));
+                    json.endObject();
+                }
+                json.endArray();
+                break;
+            case DataType::DeviceMapping:
+                json.beginArray(key);
+                for (const DeviceMapping* mapping : *entry->value.devMap) {
+                    json.beginObject();
+                    json.addString(JSON_KEY_DEVICEMAPPING_DEVICE, mapping->device);
+                    json.addNumber(JSON_KEY_DEVICEMAPPING_LED, mapping->ledNumber);
+                    if (mapping->path.length() > 0)
+                        json.addString(JSON_KEY_DEVICEMAPPING_PATH, mapping->path);
+                    if (mapping->debounce > 0)
+                        json.addNumber(JSON_KEY_DEVICEMAPPING_DEBOUNCE, mapping->debounce);
+                    json.endObject();
+                }
+                json.endArray();
+                break;
+        }
+    }
+    if (prevGroup != Group::__Last)
+        json.endObject();
+    json.endObject();
 }
@@ -5,8 +5,12 @@
 #include <ArduinoJson.h>
 #include <vector>
 
-#define HSD_VERSION         "0.9"
-#define FILENAME_MAINCONFIG "/config.json"
+#include "HSDJsonWriter.hpp"
+#include "HSDPerfectHash.hpp"
+
+#define HSD_VERSION             "0.9"
+#define FILENAME_MAINCONFIG     "/config.json"
+#define FILENAME_MAINCONFIG_NEW "/config.new" // complete new config file, renamed to FILENAME_MAINCONFIG
 
 // comment out next line if you do not need the clock module
 #define HSD_CLOCK_ENABLED
@@ -34,10 +38,12 @@ public:
      * This struct is used for mapping a device name to a led number, that means a specific position on the led stripe
      */
     struct DeviceMapping {
-        DeviceMapping(String n, uint8_t l) : device(n), ledNumber(l) { }
+        DeviceMapping(String n, uint8_t l, String p = "", uint16_t d = 0) : debounce(d), device(n), ledNumber(l), path(p) { }
 
-        String  device;    // name of the device
-        uint8_t ledNumber; // led number on which reactions for this device are displayed
+        uint16_t debounce;  // time in ms a new status has to be stable before it is shown, 0 = show immediately
+        String   device;    // name of the device
+        uint8_t  ledNumber; // led number on which reactions for this device are displayed
+        String   path;      // JSON path of the status value within the message, empty if the message is the status
     };
 
     /*
@@ -110,6 +116,8 @@ public:
 
     void                                 begin();
     inline const vector<ConfigEntry*>&   cfgEntries() { return m_entries; }
+    bool                                 deleteColorMapping(size_t index);
+    bool                                 deleteDeviceMapping(size_t index);
 #if defined HSD_BLUETOOTH_ENABLED && defined ESP32
     inline bool                          getBluetoothEnabled() const { return m_cfgBluetoothEnabled; }
 #endif
@@ -124,17 +132,27 @@ public:
 #endif // HSD_CLOCK_ENABLED
     inline const vector<ColorMapping*>&  getColorMap() const { return m_cfgColorMapping; }
     int                                  getColorMapIndex(const String& msg) const;
+    inline uint32_t                      getColorMapVersion() const { return m_colorMapVersion; }
+    inline uint32_t                      getConfigVersion() const { return m_configVersion; }
     String                               getDevice(int ledNumber) const;
+    int                                  getDeviceIndex(const String& deviceName) const;
+    String                               getDevicePath(const String& deviceName) const;
     inline const vector<DeviceMapping*>& getDeviceMap() const { return m_cfgDeviceMapping; }
+    inline uint32_t                      getDeviceMapVersion() const { return m_deviceMapVersion; }
     inline const String&                 getHost() const { return m_cfgHost; }
     inline Behavior                      getLedBehavior(unsigned int colorMapIndex) const { return m_cfgColorMapping[colorMapIndex]->behavior; }
     inline uint8_t                       getLedBrightness() const { return m_cfgLedBrightness; }
     inline uint32_t                      getLedColor(unsigned int colorMapIndex) const { return m_cfgColorMapping[colorMapIndex]->color; }
     inline uint8_t                       getLedDataPin() const { return m_cfgLedDataPin; }
+    inline uint16_t                      getLedStreamPort() const { return m_cfgLedStreamPort; }
     uint8_t                              getLedNumber(const String& device) const;
+    inline const String&                 getMqttBulkDevice() const { return m_cfgMqttBulkDevice; }
+    inline bool                          getMqttLedMirror() const { return m_cfgMqttLedMirror; }
+    inline uint16_t                      getMqttMaxPayload() const { return m_cfgMqttMaxPayload; }
     inline const String&                 getMqttOutTopic() const { return m_cfgMqttOutTopic; }
     String                               getMqttOutTopic(const String& topic) const;
     inline const String&                 getMqttPassword() const { return m_cfgMqttPassword; }
+    inline bool                          getMqttPersistentSession() const { return m_cfgMqttPersistentSession; }
     inline uint16_t                      getMqttPort() const { return m_cfgMqttPort; }
     inline const String&                 getMqttServer() const { return m_cfgMqttServer; }
     inline const String&                 getMqttStatusTopic() const { return m_cfgMqttStatusTopic; }
@@ -143,6 +161,7 @@ public:
 #endif    
     inline const String&                 getMqttUser() const { return m_cfgMqttUser; }
     inline uint8_t                       getNumberOfLeds() const { return m_cfgNumberOfLeds; }
+    inline const String&                 getRules() const { return m_cfgRules; }
 #ifdef HSD_SENSOR_ENABLED
     inline uint16_t                      getSensorAltitude() const { return m_cfgSensorAltitude; }
     inline bool                          getSensorI2CEnabled() const { return m_cfgSensorI2CEnabled; }
@@ -152,17 +171,34 @@ public:
     inline bool                          getSensorPirEnabled() const { return m_cfgSensorPirEnabled; }
     inline uint8_t                       getSensorPirPin() const { return m_cfgSensorPirPin; }
 #endif // HSD_SENSOR_ENABLED
+    inline uint16_t                      getStatusUdpPort() const { return m_cfgStatusUdpPort; }
     inline const String&                 getWifiPSK() const { return m_cfgWifiPSK; }
     inline const String&                 getWifiSSID() const { return m_cfgWifiSSID; }
     String                               groupDescription(Group group) const;
+    void                                 handle();
     String                               hex2string(uint32_t value) const;
+    bool                                 importConfigFile(const char* path);
+    bool                                 insertColorMapping(size_t index, const ColorMapping& mapping);
+    bool                                 insertDeviceMapping(size_t index, const DeviceMapping& mapping);
+    inline bool                          isWritePending() const { return m_writePending; }
+    bool                                 moveColorMapping(size_t from, size_t to);
+    bool                                 moveDeviceMapping(size_t from, size_t to);
     bool                                 readConfigFile();
     void                                 setColorMap(vector<ColorMapping*>& values);
     void                                 setDeviceMap(vector<DeviceMapping*>& values);
     uint32_t                             string2hex(String value) const;
+    bool                                 updateColorMapping(size_t index, const ColorMapping& mapping);
+    bool                                 updateDeviceMapping(size_t index, const DeviceMapping& mapping);
+    void                                 updateMapIndexes();
     void                                 writeConfigFile() const;
+    void                                 writeConfigFileDeferred();
+    void                                 writeJson(HSDJsonWriter& json) const;
 
 private:
+    void                   buildColorMapIndex();
+    void                   buildDeviceMapIndex();
+    bool                   replaceConfigFile() const;
+
 #if defined HSD_BLUETOOTH_ENABLED && defined ESP32
     bool                   m_cfgBluetoothEnabled;
 #endif    
@@ -180,8 +216,13 @@ private:
     String                 m_cfgHost;
     uint8_t                m_cfgLedBrightness;
     uint8_t                m_cfgLedDataPin;
+    uint16_t               m_cfgLedStreamPort;
+    String                 m_cfgMqttBulkDevice;
+    bool                   m_cfgMqttLedMirror;
+    uint16_t               m_cfgMqttMaxPayload;
     String                 m_cfgMqttOutTopic;
     String                 m_cfgMqttPassword;
+    bool                   m_cfgMqttPersistentSession;
     uint16_t               m_cfgMqttPort;
     String                 m_cfgMqttServer;
     String                 m_cfgMqttStatusTopic;
@@ -190,6 +231,7 @@ private:
 #endif // MQTT_TEST_TOPIC    
     String                 m_cfgMqttUser;
     uint8_t                m_cfgNumberOfLeds;
+    String                 m_cfgRules;
 #ifdef HSD_SENSOR_ENABLED
     bool                   m_cfgSensorI2CEnabled;
     uint8_t                m_cfgSensorInterval;
@@ -199,10 +241,21 @@ private:
     bool                   m_cfgSensorPirEnabled;
     uint8_t                m_cfgSensorPirPin;
 #endif // HSD_SENSOR_ENABLED
+    uint16_t               m_cfgStatusUdpPort;
     String                 m_cfgWifiPSK;
     String                 m_cfgWifiSSID;
     
+    HSDPerfectHash         m_colorMapIndex;
+    bool                   m_colorMapIndexDirty;  // rows were edited, lookups are linear until updateMapIndexes()
+    uint32_t               m_colorMapVersion;     // incremented whenever the color mapping is replaced or reordered
+    mutable uint32_t       m_configVersion;       // incremented whenever the configuration is read, written or edited
+    HSDPerfectHash         m_deviceMapIndex;
+    bool                   m_deviceMapIndexDirty;
+    uint32_t               m_deviceMapVersion;    // incremented whenever the device mapping is replaced or reordered
     vector<ConfigEntry*>   m_entries;
+    unsigned long          m_writeFirst;          // first edit of a deferred write
+    unsigned long          m_writeLast;           // last edit of a deferred write
+    mutable bool           m_writePending;
 };
 
 #endif // HSDCONFIG_H
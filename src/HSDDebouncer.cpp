@@ -0,0 +1,131 @@
+#include "HSDDebouncer.hpp"
+
+#define FLAG_VALID    0x01 // a status was received
+#define FLAG_PENDING  0x02 // the received status is not shown yet
+#define FLAG_FLAPPING 0x04
+
+HSDDebouncer::HSDDebouncer() :
+    m_flapping(0),
+    m_pending(0),
+    m_pollPos(0)
+{
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDDebouncer::force(size_t device, HSDConfig::Behavior behavior, uint32_t color, uint8_t tag, 
+                         unsigned long now) {
+    if (device >= m_states.size())
+        return;
+    
+    State& state = m_states[device];
+    if (state.flags & FLAG_PENDING)
+        m_pending--;
+    if (state.flags & FLAG_FLAPPING)
+        m_flapping--;
+    state.behavior = static_cast<uint8_t>(behavior);
+    state.changes = 0;
+    state.color = color;
+    state.flags = FLAG_VALID;
+    state.tag = tag;
+    state.lastChange = state.windowStart = now;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDDebouncer::isFlapping(size_t device) const {
+    return device < m_states.size() && (m_states[device].flags & FLAG_FLAPPING);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDDebouncer::poll(unsigned long now, size_t& device, HSDConfig::Behavior& behavior, uint32_t& color, 
+                        uint8_t& tag) {
+    for (size_t count = 0; count < m_states.size() && m_pending > 0; count++) {
+        m_pollPos = (m_pollPos + 1) % m_states.size();
+        State& state = m_states[m_pollPos];
+        if ((state.flags & FLAG_PENDING) == 0)
+            continue;
+        
+        bool flapping = state.flags & FLAG_FLAPPING;
+        if (now - state.lastChange >= (flapping ? HSD_FLAP_SETTLE_MILLIS : state.debounce)) {
+            if (flapping) {
+                state.flags &= ~FLAG_FLAPPING;
+                state.changes = 0;
+                m_flapping--;
+            }
+            state.flags &= ~FLAG_PENDING;
+            m_pending--;
+            device = m_pollPos;
+            behavior = static_cast<HSDConfig::Behavior>(state.behavior);
+            color = state.color;
+            tag = state.tag;
+            return true;
+        }
+    }
+    return false;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDDebouncer::reset(size_t devices) {
+    m_states.assign(devices, State { 0, 0, 0, 0, 0, 0, 0, 0 });
+    m_flapping = 0;
+    m_pending = 0;
+    m_pollPos = 0;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+HSDDebouncer::Result HSDDebouncer::update(size_t device, uint16_t debounce, HSDConfig::Behavior behavior, 
+                                          uint32_t color, uint8_t tag, unsigned long now) {
+    if (device >= m_states.size())
+        return Result::Apply;
+    
+    State& state = m_states[device];
+    bool changed = (state.flags & FLAG_VALID) == 0 || state.behavior != static_cast<uint8_t>(behavior) || 
+                   state.color != color;
+    bool flapping = state.flags & FLAG_FLAPPING;
+    state.tag = tag; // a message shown the same way is not a change, but the tag is the latest
+    if (!changed) // a repeated status confirms the pending one, but does not shorten the time to wait
+        return (state.flags & FLAG_PENDING) ? Result::Hold : Result::Apply;
+    
+    state.behavior = static_cast<uint8_t>(behavior);
+    state.color = color;
+    state.debounce = debounce;
+    state.lastChange = now;
+    if ((state.flags & FLAG_VALID) == 0) { // first status of the device is shown immediately
+        state.flags = FLAG_VALID;
+        state.windowStart = now;
+        return Result::Apply;
+    }
+    
+    if (now - state.windowStart >= HSD_FLAP_WINDOW_MILLIS) {
+        state.windowStart = now;
+        state.changes = 0;
+    }
+    if (state.changes < 0xFF)
+        state.changes++;
+    
+    if (!flapping && state.changes >= HSD_FLAP_CHANGES) {
+        state.flags |= FLAG_FLAPPING;
+        m_flapping++;
+        if ((state.flags & FLAG_PENDING) == 0) {
+            state.flags |= FLAG_PENDING;
+            m_pending++;
+        }
+        return Result::StartFlapping;
+    }
+    if (flapping || debounce > 0) {
+        if ((state.flags & FLAG_PENDING) == 0) {
+            state.flags |= FLAG_PENDING;
+            m_pending++;
+        }
+        return Result::Hold;
+    }
+    if (state.flags & FLAG_PENDING) { // debounce was switched off in the meantime
+        state.flags &= ~FLAG_PENDING;
+        m_pending--;
+    }
+    return Result::Apply;
+}
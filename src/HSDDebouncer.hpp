@@ -0,0 +1,58 @@
+#ifndef HSDDEBOUNCER_H
+#define HSDDEBOUNCER_H
+
+#include <Arduino.h>
+#include <vector>
+
+#include "HSDConfig.hpp"
+
+using namespace std;
+
+#define HSD_FLAP_CHANGES       5     // that many changes ...
+#define HSD_FLAP_WINDOW_MILLIS 10000 // ... within this time mark a device as flapping
+#define HSD_FLAP_SETTLE_MILLIS 10000 // a flapping device is shown normally again after this time without change
+
+/*
+ * Debounce and flap detection for device statuses. Holds one compact entry per device mapping, indexed like
+ * HSDConfig::getDeviceMap(), so each received status is handled in constant time. Held back statuses are returned
+ * by poll() once they are due, together with the tag the caller passed with the status (e.g. its color map index).
+ */
+class HSDDebouncer {
+public:
+    enum class Result : uint8_t {
+        Apply = 0,     // show the status now
+        Hold,          // status is held back (debounce running, device flapping or status unchanged)
+        StartFlapping  // device started flapping, show the flapping behavior
+    };
+
+    HSDDebouncer();
+
+    void                force(size_t device, HSDConfig::Behavior behavior, uint32_t color, uint8_t tag, 
+                              unsigned long now);
+    inline size_t       getFlapping() const { return m_flapping; }
+    bool                isFlapping(size_t device) const;
+    bool                poll(unsigned long now, size_t& device, HSDConfig::Behavior& behavior, uint32_t& color, 
+                             uint8_t& tag);
+    void                reset(size_t devices);
+    Result              update(size_t device, uint16_t debounce, HSDConfig::Behavior behavior, uint32_t color, 
+                               uint8_t tag, unsigned long now);
+
+private:
+    struct State {
+        uint32_t color;       // last received status
+        uint32_t lastChange;
+        uint32_t windowStart; // start of the flap detection window
+        uint16_t debounce;
+        uint8_t  behavior;
+        uint8_t  changes;     // within the flap detection window
+        uint8_t  flags;
+        uint8_t  tag;         // of the last received status
+    };
+
+    size_t        m_flapping;
+    size_t        m_pending; // number of entries with a held back status
+    size_t        m_pollPos;
+    vector<State> m_states;
+};
+
+#endif // HSDDEBOUNCER_H
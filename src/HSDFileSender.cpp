@@ -0,0 +1,82 @@
+#include "HSDFileSender.hpp"
+
+#ifdef ESP32
+#include <lwip/sockets.h>
+#endif
+
+HSDFileSender::HSDFileSender() :
+    m_aborted(0),
+    m_completed(0)
+{
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDFileSender::add(WiFiClient client, File file) {
+    if (!canAdd() || !file)
+        return false;
+    Transfer transfer;
+    transfer.client = client;
+    transfer.file = file;
+    transfer.progressLast = millis();
+    m_transfers.push_back(transfer);
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+size_t HSDFileSender::getWritable(WiFiClient& client) const {
+#ifdef ESP8266
+    size_t free = client.availableForWrite();
+    return free < HSD_FILE_SENDER_SLICE ? free : HSD_FILE_SENDER_SLICE;
+#elif defined(ESP32)
+    // the ESP32 client does not tell the free buffer size, but whether the socket is writable at all
+    int fd = client.fd();
+    if (fd < 0)
+        return 0;
+    fd_set writeSet;
+    FD_ZERO(&writeSet);
+    FD_SET(fd, &writeSet);
+    struct timeval timeout = {0, 0};
+    return select(fd + 1, nullptr, &writeSet, nullptr, &timeout) > 0 ? HSD_FILE_SENDER_SLICE : 0;
+#endif
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDFileSender::handle() {
+    // one slice per transfer and call
+    uint8_t block[HSD_FILE_SENDER_SLICE];
+    for (auto it = m_transfers.begin(); it != m_transfers.end();) {
+        Transfer& transfer = *it;
+        size_t remaining = transfer.file.available();
+        bool failed = !transfer.client.connected();
+        if (remaining > 0 && !failed) {
+            size_t length = getWritable(transfer.client);
+            if (length > remaining)
+                length = remaining;
+            if (length > 0) {
+                length = transfer.file.read(block, length);
+                failed = length == 0 || transfer.client.write(block, length) != length; // the slice is lost
+                if (!failed) {
+                    transfer.progressLast = millis();
+                    remaining -= length;
+                }
+            }
+        }
+
+        if (remaining == 0 || failed || millis() - transfer.progressLast >= HSD_FILE_SENDER_TIMEOUT) {
+            // a completed connection is closed when the web server released it as well, after the data was sent
+            if (remaining == 0) {
+                m_completed++;
+            } else {
+                transfer.client.stop();
+                m_aborted++;
+            }
+            transfer.file.close();
+            it = m_transfers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
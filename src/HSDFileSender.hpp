@@ -0,0 +1,46 @@
+#ifndef HSDFILESENDER_H
+#define HSDFILESENDER_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <WiFiClient.h>
+#include <vector>
+
+using namespace std;
+
+#define HSD_FILE_SENDER_MAX     4     // transfers kept, further requests are answered synchronously
+#define HSD_FILE_SENDER_SLICE   512   // bytes per transfer and call of handle(), read into a buffer on the stack
+#define HSD_FILE_SENDER_TIMEOUT 10000 // transfers without progress for that long are aborted
+
+/*
+ * Sends files to HTTP clients in slices from the main loop. The web server only sends the response headers and hands
+ * the connection over, so a large file does not block the loop (MQTT, LED animation) until it is transferred. A slice
+ * is only written when the connection can take it without blocking. This does not serve files in parallel: the web
+ * server keeps waiting on the connection it handed over and accepts the next request only when it is closed.
+ */
+class HSDFileSender {
+public:
+    HSDFileSender();
+
+    bool            add(WiFiClient client, File file);
+    inline bool     canAdd() const { return m_transfers.size() < HSD_FILE_SENDER_MAX; }
+    inline uint32_t getAborted() const { return m_aborted; }
+    inline size_t   getActive() const { return m_transfers.size(); }
+    inline uint32_t getCompleted() const { return m_completed; }
+    void            handle();
+
+private:
+    struct Transfer {
+        WiFiClient    client;
+        File          file;
+        unsigned long progressLast;
+    };
+
+    size_t getWritable(WiFiClient& client) const;
+
+    uint32_t         m_aborted;
+    uint32_t         m_completed;
+    vector<Transfer> m_transfers;
+};
+
+#endif // HSDFILESENDER_H
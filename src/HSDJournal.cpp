@@ -0,0 +1,277 @@
+#include "HSDJournal.hpp"
+#include "HSDLogger.hpp"
+
+#ifdef ARDUINO_ARCH_ESP32
+#include <SPIFFS.h>
+#else
+#include <FS.h>
+#endif
+
+static size_t countRecords(const char* path) {
+    if (!SPIFFS.exists(path))
+        return 0;
+    File file = SPIFFS.open(path, "r");
+    if (!file)
+        return 0;
+    size_t records = file.size() / sizeof(HSDJournal::Record);
+    file.close();
+    return records;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+static bool readRecord(File& file, const char* path, size_t index, HSDJournal::Record& record) {
+    if (!file)
+        file = SPIFFS.open(path, "r");
+    return file && file.seek(index * sizeof(HSDJournal::Record)) &&
+           file.read(reinterpret_cast<uint8_t*>(&record), sizeof(record)) == sizeof(record);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+HSDJournal::HSDJournal() :
+    m_drops(0),
+    m_fileRecords(0),
+    m_flushes(0),
+    m_oldRecords(0),
+    m_pendingSince(0),
+    m_ramCount(0),
+    m_ramStart(0),
+    m_remapFailed(0),
+    m_remapPending(false)
+{
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJournal::begin() {
+    m_fileRecords = countRecords(FILENAME_JOURNAL);
+    m_oldRecords = countRecords(FILENAME_JOURNAL_OLD);
+    Logger.log("Status journal has %u records", getSize());
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJournal::flush() {
+    if (m_ramCount == 0 || !remapFiles()) // records are only appended to files with the current rows
+        return;
+
+    if (m_fileRecords + m_ramCount > HSD_JOURNAL_FILE_RECORDS) {
+        SPIFFS.remove(FILENAME_JOURNAL_OLD);
+        SPIFFS.rename(FILENAME_JOURNAL, FILENAME_JOURNAL_OLD);
+        m_oldRecords = m_fileRecords;
+        m_fileRecords = 0;
+    }
+
+    File file = SPIFFS.open(FILENAME_JOURNAL, "a");
+    if (!file) {
+        Logger.log("Failed to open the status journal");
+        return;
+    }
+    // the pending records may wrap around the end of the ring
+    size_t first = m_ramCount < HSD_JOURNAL_RAM_RECORDS - m_ramStart ? m_ramCount : HSD_JOURNAL_RAM_RECORDS - m_ramStart;
+    size_t bytes = file.write(reinterpret_cast<const uint8_t*>(&m_ram[m_ramStart]), first * sizeof(Record));
+    if (first < m_ramCount)
+        bytes += file.write(reinterpret_cast<const uint8_t*>(&m_ram[0]), (m_ramCount - first) * sizeof(Record));
+    file.close();
+
+    size_t written = bytes / sizeof(Record);
+    m_fileRecords += written;
+    m_ramStart = (m_ramStart + written) % HSD_JOURNAL_RAM_RECORDS;
+    m_ramCount -= written;
+    m_pendingSince = millis();
+    m_flushes++;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJournal::handle() {
+    if (m_ramCount >= HSD_JOURNAL_FLUSH_RECORDS ||
+        (m_ramCount > 0 && millis() - m_pendingSince >= HSD_JOURNAL_FLUSH_MILLIS))
+        flush();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+size_t HSDJournal::read(size_t start, size_t count, RecordCallback callback) const {
+    // index 0 is the newest record: RAM first, then the journal file, then the previous one
+    size_t total = getSize();
+    size_t index = start;
+    File file;
+    File oldFile;
+    for (; index < total && index < start + count; index++) {
+        Record record;
+        if (index < m_ramCount) {
+            record = m_ram[(m_ramStart + m_ramCount - 1 - index) % HSD_JOURNAL_RAM_RECORDS];
+        } else {
+            if (index < m_ramCount + m_fileRecords) {
+                if (!readRecord(file, FILENAME_JOURNAL, m_ramCount + m_fileRecords - 1 - index, record))
+                    break;
+            } else if (!readRecord(oldFile, FILENAME_JOURNAL_OLD, total - 1 - index, record)) {
+                break;
+            }
+            if (m_remapPending && !remapRecord(record, m_fileDevices, m_fileColors))
+                record.device = HSD_JOURNAL_INDEX_NONE; // deleted device, dropped by remapFiles()
+        }
+        callback(record);
+    }
+    if (file)
+        file.close();
+    if (oldFile)
+        oldFile.close();
+    return index - start;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJournal::record(size_t device, uint8_t colorIndex, uint32_t time, bool uptime) {
+    if (device >= m_last.size() || device > 255 || m_last[device] == colorIndex)
+        return;
+
+    if (m_ramCount == HSD_JOURNAL_RAM_RECORDS) {
+        flush();
+        if (m_ramCount == HSD_JOURNAL_RAM_RECORDS) { // flash not writable, drop the oldest record
+            m_ramStart = (m_ramStart + 1) % HSD_JOURNAL_RAM_RECORDS;
+            m_ramCount--;
+            m_drops++;
+        }
+    }
+    if (m_ramCount == 0)
+        m_pendingSince = millis();
+
+    Record& record = m_ram[(m_ramStart + m_ramCount++) % HSD_JOURNAL_RAM_RECORDS];
+    record.time = time;
+    record.device = device;
+    record.from = m_last[device];
+    record.to = colorIndex;
+    record.flags = uptime ? FLAG_UPTIME : 0;
+    m_last[device] = colorIndex;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJournal::reset(size_t devices) {
+    m_last.assign(devices, HSD_JOURNAL_INDEX_NONE);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJournal::remap(const vector<uint8_t>& devices, size_t deviceCount, const vector<uint8_t>& colors) {
+    // devices and colors map old to new row indexes, HSD_JOURNAL_INDEX_NONE for a deleted device and 
+    // HSD_JOURNAL_INDEX_OTHER for a deleted message, records of deleted devices are dropped
+    bool identity = devices.size() <= deviceCount;
+    for (size_t idx = 0; identity && idx < devices.size(); idx++)
+        identity = devices[idx] == idx;
+    for (size_t idx = 0; identity && idx < colors.size(); idx++)
+        identity = colors[idx] == idx;
+
+    vector<uint8_t> last(deviceCount, HSD_JOURNAL_INDEX_NONE);
+    for (size_t idx = 0; idx < m_last.size() && idx < devices.size(); idx++) {
+        if (devices[idx] < deviceCount) {
+            Record record = { 0, static_cast<uint8_t>(idx), m_last[idx], m_last[idx], 0 };
+            remapRecord(record, devices, colors);
+            last[devices[idx]] = record.to;
+        }
+    }
+    m_last = last;
+    if (identity)
+        return;
+
+    size_t kept = 0;
+    for (size_t idx = 0; idx < m_ramCount; idx++) {
+        Record record = m_ram[(m_ramStart + idx) % HSD_JOURNAL_RAM_RECORDS];
+        if (remapRecord(record, devices, colors))
+            m_ram[(m_ramStart + kept++) % HSD_JOURNAL_RAM_RECORDS] = record;
+    }
+    m_ramCount = kept;
+
+    // edits often come in series, so the files are rewritten once by remapFiles() for all of them
+    if (m_remapPending) {
+        for (uint8_t& device : m_fileDevices)
+            device = device < devices.size() ? devices[device] : HSD_JOURNAL_INDEX_NONE;
+        for (uint8_t& color : m_fileColors) {
+            if (color < HSD_JOURNAL_INDEX_OTHER)
+                color = color < colors.size() ? colors[color] : HSD_JOURNAL_INDEX_OTHER;
+        }
+    } else {
+        m_fileDevices = devices;
+        m_fileColors = colors;
+        m_remapPending = true;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDJournal::remapFiles() {
+    // both files are written completely before they replace the journal, so a full flash keeps the old ones
+    if (!m_remapPending)
+        return true;
+    if (m_remapFailed != 0 && millis() - m_remapFailed < HSD_JOURNAL_REMAP_RETRY)
+        return false;
+
+    size_t fileRecords;
+    size_t oldRecords;
+    if (!remapFile(FILENAME_JOURNAL, FILENAME_JOURNAL_TMP, fileRecords) || 
+        !remapFile(FILENAME_JOURNAL_OLD, FILENAME_JOURNAL_OLD_TMP, oldRecords)) {
+        SPIFFS.remove(FILENAME_JOURNAL_TMP);
+        SPIFFS.remove(FILENAME_JOURNAL_OLD_TMP);
+        m_remapFailed = millis();
+        Logger.log("Failed to rewrite the status journal, kept the files");
+        return false;
+    }
+    if (SPIFFS.exists(FILENAME_JOURNAL_TMP)) {
+        SPIFFS.remove(FILENAME_JOURNAL);
+        SPIFFS.rename(FILENAME_JOURNAL_TMP, FILENAME_JOURNAL);
+    }
+    if (SPIFFS.exists(FILENAME_JOURNAL_OLD_TMP)) {
+        SPIFFS.remove(FILENAME_JOURNAL_OLD);
+        SPIFFS.rename(FILENAME_JOURNAL_OLD_TMP, FILENAME_JOURNAL_OLD);
+    }
+    m_fileRecords = fileRecords;
+    m_oldRecords = oldRecords;
+    m_fileColors.clear();
+    m_fileDevices.clear();
+    m_remapFailed = 0;
+    m_remapPending = false;
+    Logger.log("Status journal remapped, %u records", getSize());
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDJournal::remapRecord(Record& record, const vector<uint8_t>& devices, const vector<uint8_t>& colors) const {
+    if (record.device >= devices.size() || devices[record.device] == HSD_JOURNAL_INDEX_NONE)
+        return false;
+    record.device = devices[record.device];
+    if (record.from < HSD_JOURNAL_INDEX_OTHER)
+        record.from = record.from < colors.size() ? colors[record.from] : HSD_JOURNAL_INDEX_OTHER;
+    if (record.to < HSD_JOURNAL_INDEX_OTHER)
+        record.to = record.to < colors.size() ? colors[record.to] : HSD_JOURNAL_INDEX_OTHER;
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDJournal::remapFile(const char* path, const char* tmpPath, size_t& kept) const {
+    // writes the remapped records to tmpPath, false if it could not be written completely
+    kept = 0;
+    SPIFFS.remove(tmpPath);
+    if (!SPIFFS.exists(path))
+        return true;
+    File file = SPIFFS.open(path, "r");
+    if (!file)
+        return false;
+    File tmpFile = SPIFFS.open(tmpPath, "w");
+    bool complete(tmpFile);
+    Record record;
+    while (complete && file.read(reinterpret_cast<uint8_t*>(&record), sizeof(record)) == sizeof(record)) {
+        if (remapRecord(record, m_fileDevices, m_fileColors)) {
+            complete = tmpFile.write(reinterpret_cast<const uint8_t*>(&record), sizeof(record)) == sizeof(record);
+            kept++;
+        }
+    }
+    file.close();
+    if (tmpFile)
+        tmpFile.close();
+    return complete;
+}
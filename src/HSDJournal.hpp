@@ -0,0 +1,78 @@
+#ifndef HSDJOURNAL_H
+#define HSDJOURNAL_H
+
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+
+using namespace std;
+
+#define FILENAME_JOURNAL            "/journal.bin"
+#define FILENAME_JOURNAL_OLD        "/journal.old"
+#define FILENAME_JOURNAL_TMP        "/journal.tmp"    // journal files while they are rewritten by remapFiles()
+#define FILENAME_JOURNAL_OLD_TMP    "/journal.old.tmp"
+
+#define HSD_JOURNAL_RAM_RECORDS     64                // records kept in RAM until they are written to flash
+#define HSD_JOURNAL_FILE_RECORDS    2048              // records per file, the older file is removed when a new one starts
+#define HSD_JOURNAL_FLUSH_RECORDS   32                // write to flash once that many records are pending ...
+#define HSD_JOURNAL_FLUSH_MILLIS    (15 * 60 * 1000)  // ... or the oldest pending record is that old
+#define HSD_JOURNAL_REMAP_RETRY     (60 * 1000)       // a failed rewrite of the files is tried again after that time
+#define HSD_JOURNAL_INDEX_NONE      0xFF              // no status received yet
+#define HSD_JOURNAL_INDEX_OTHER     0xFE              // message not in the color mapping (e.g. a HEX color)
+
+/*
+ * Journal of the status transitions of the devices. Records are collected in RAM and appended to SPIFFS in batches.
+ * The journal file is only appended, when it is full it replaces the previous one, so the history covers between
+ * one and two files. Records refer to rows of the device and color mapping, remap() rewrites them when rows move.
+ * The files are only rewritten by remapFiles(), until then their records are mapped when they are read.
+ */
+class HSDJournal {
+public:
+    struct Record {
+        uint32_t time;   // seconds since 1970 or, with FLAG_UPTIME, since start
+        uint8_t  device; // index in the device mapping
+        uint8_t  from;   // index in the color mapping
+        uint8_t  to;
+        uint8_t  flags;
+    };
+
+    static const uint8_t FLAG_UPTIME = 0x01;
+
+    typedef std::function<void(const Record& record)> RecordCallback;
+
+    HSDJournal();
+
+    void            begin();
+    void            flush();
+    inline uint32_t getDrops() const { return m_drops; }
+    inline uint32_t getFlushes() const { return m_flushes; }
+    inline size_t   getPending() const { return m_ramCount; }
+    inline size_t   getSize() const { return m_ramCount + m_fileRecords + m_oldRecords; }
+    void            handle();
+    inline bool     isRemapPending() const { return m_remapPending; }
+    size_t          read(size_t start, size_t count, RecordCallback callback) const;
+    void            record(size_t device, uint8_t colorIndex, uint32_t time, bool uptime);
+    void            remap(const vector<uint8_t>& devices, size_t deviceCount, const vector<uint8_t>& colors);
+    bool            remapFiles();
+    void            reset(size_t devices);
+
+private:
+    bool            remapRecord(Record& record, const vector<uint8_t>& devices, const vector<uint8_t>& colors) const;
+    bool            remapFile(const char* path, const char* tmpPath, size_t& kept) const;
+
+    uint32_t        m_drops;         // records lost because flash could not be written
+    vector<uint8_t> m_fileColors;    // color rows of the file records to the current rows while a remap is pending
+    vector<uint8_t> m_fileDevices;   // device rows of the file records to the current rows while a remap is pending
+    size_t          m_fileRecords;
+    uint32_t        m_flushes;
+    vector<uint8_t> m_last;          // color mapping index of the last status per device
+    size_t          m_oldRecords;
+    unsigned long   m_pendingSince;
+    Record          m_ram[HSD_JOURNAL_RAM_RECORDS];
+    size_t          m_ramCount;
+    size_t          m_ramStart;
+    unsigned long   m_remapFailed;   // time of the last failed rewrite of the files
+    bool            m_remapPending;  // the files still refer to the rows of m_fileDevices and m_fileColors
+};
+
+#endif // HSDJOURNAL_H
@@ -0,0 +1,104 @@
+#include "HSDJsonPath.hpp"
+
+HSDJsonPath::HSDJsonPath(const char* path) :
+    m_done(false),
+    m_found(false),
+    m_inArray(false),
+    m_index(0),
+    m_matched(0),
+    m_path(path),
+    m_pending(false),
+    m_scanner([this](HSDJsonScanner::Token token, uint8_t depth, const char* text, size_t length) { 
+        onToken(token, depth, text, length); 
+    }),
+    m_segments(0)
+{
+    m_value[0] = 0;
+    size_t start(0), pos(0);
+    for (;; pos++) {
+        if (path[pos] == '.' || path[pos] == 0) {
+            if (m_segments == HSD_JSON_MAX_DEPTH || pos - start > 0xFF || pos > 0xFF) {
+                m_done = true; // path too complex, never matches
+                break;
+            }
+            m_segmentStart[m_segments] = start;
+            m_segmentLength[m_segments++] = pos - start;
+            start = pos + 1;
+            if (path[pos] == 0)
+                break;
+        }
+    }
+    if (pos == 0) // empty path
+        m_done = true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDJsonPath::feed(const char* data, size_t length) {
+    for (size_t idx = 0; idx < length && !m_done; idx++)
+        if (!m_scanner.feed(data[idx]))
+            m_done = true;
+    return !m_done;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDJsonPath::isSegment(uint8_t segment, const char* text, size_t length) const {
+    return m_segmentLength[segment] == length && strncmp(m_path + m_segmentStart[segment], text, length) == 0;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJsonPath::onToken(HSDJsonScanner::Token token, uint8_t depth, const char* text, size_t length) {
+    // containers opened after a match have depth m_matched + 1, anything deeper can be ignored
+    if (m_done)
+        return;
+
+    bool isValue = token == HSDJsonScanner::Token::ObjectStart || token == HSDJsonScanner::Token::ArrayStart ||
+                   token == HSDJsonScanner::Token::String || token == HSDJsonScanner::Token::Literal;
+    bool isContainer = token == HSDJsonScanner::Token::ObjectStart || token == HSDJsonScanner::Token::ArrayStart;
+    if (depth == 0) {
+        if (isContainer) { // root container
+            m_inArray = token == HSDJsonScanner::Token::ArrayStart;
+            m_index = 0;
+        } else {
+            m_done = true;
+        }
+        return;
+    }
+    if (depth != m_matched + 1) {
+        if (depth == m_matched && !isValue) // the matched container was closed without finding the path
+            m_done = true;
+        return;
+    }
+
+    if (token == HSDJsonScanner::Token::Key) {
+        m_pending = !m_inArray && !m_scanner.isTruncated() && isSegment(m_matched, text, length);
+        return;
+    }
+    if (!isValue)
+        return;
+
+    if (m_inArray) {
+        char index[6];
+        snprintf(index, sizeof(index), "%u", m_index++);
+        m_pending = isSegment(m_matched, index, strlen(index));
+    }
+    if (!m_pending)
+        return;
+
+    m_pending = false;
+    if (m_matched + 1 == m_segments) {
+        if (!isContainer) {
+            memcpy(m_value, text, length + 1);
+            m_found = true;
+        }
+        m_done = true;
+    } else if (isContainer) {
+        m_matched++;
+        m_inArray = token == HSDJsonScanner::Token::ArrayStart;
+        m_index = 0;
+    } else {
+        m_done = true;
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef HSDJSONPATH_H
+#define HSDJSONPATH_H
+
+#include <Arduino.h>
+
+#include "HSDJsonScanner.hpp"
+
+/*
+ * Extracts a single value from a JSON payload while it is fed, without building a document. The path consists of
+ * keys (or array indices) separated by dots, e.g. "state", "update.state" or "sensors.0.value". Scanning stops as
+ * soon as the value is found, only string, number and literal values can be extracted.
+ */
+class HSDJsonPath {
+public:
+    HSDJsonPath(const char* path);
+
+    bool               feed(const char* data, size_t length); // returns false if no more data is needed
+    inline const char* getValue() const { return m_value; }
+    inline bool        isFound() const { return m_found; }
+
+private:
+    bool isSegment(uint8_t segment, const char* text, size_t length) const;
+    void onToken(HSDJsonScanner::Token token, uint8_t depth, const char* text, size_t length);
+
+    bool           m_done;
+    bool           m_found;
+    bool           m_inArray;  // the innermost matched container is an array
+    uint16_t       m_index;    // index of the next element in this array
+    uint8_t        m_matched;  // number of path segments matched by the open containers
+    const char*    m_path;
+    bool           m_pending;  // the next value belongs to the next path segment
+    HSDJsonScanner m_scanner;
+    uint8_t        m_segments;
+    uint8_t        m_segmentLength[HSD_JSON_MAX_DEPTH];
+    uint8_t        m_segmentStart[HSD_JSON_MAX_DEPTH];
+    char           m_value[HSD_JSON_TOKEN_SIZE];
+};
+
+#endif // HSDJSONPATH_H
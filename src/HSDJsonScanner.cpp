@@ -0,0 +1,331 @@
+#include "HSDJsonScanner.hpp"
+
+static inline bool isWhitespace(char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+static inline bool isLiteralChar(char ch) {
+    return (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '-' || ch == '+' ||
+           ch == '.';
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+static bool isNumber(const char* text) {
+    // -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+    if (*text == '-')
+        text++;
+    if (*text == '0')
+        text++;
+    else if (*text >= '1' && *text <= '9')
+        while (*text >= '0' && *text <= '9')
+            text++;
+    else
+        return false;
+    if (*text == '.') {
+        if (*++text < '0' || *text > '9')
+            return false;
+        while (*text >= '0' && *text <= '9')
+            text++;
+    }
+    if (*text == 'e' || *text == 'E') {
+        if (*++text == '+' || *text == '-')
+            text++;
+        if (*text < '0' || *text > '9')
+            return false;
+        while (*text >= '0' && *text <= '9')
+            text++;
+    }
+    return *text == 0;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+HSDJsonScanner::HSDJsonScanner(Callback callback) :
+    m_callback(callback)
+{
+    reset();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJsonScanner::reset() {
+    m_depth = 0;
+    m_isKey = false;
+    m_objects = 0;
+    m_state = State::Value;
+    m_surrogate = 0;
+    m_tokenLength = 0;
+    m_truncated = false;
+    m_unicode = 0;
+    m_unicodeDigits = 0;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDJsonScanner::feed(const char* data, size_t length) {
+    for (size_t idx = 0; idx < length; idx++)
+        if (!feed(data[idx]))
+            return false;
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDJsonScanner::feed(char ch) {
+    switch (m_state) {
+        case State::Value:
+        case State::ValueOrEnd:
+            if (isWhitespace(ch))
+                return true;
+            if (m_state == State::ValueOrEnd && ch == ']')
+                return endContainer(false);
+            return startValue(ch);
+
+        case State::KeyOrEnd:
+        case State::Key:
+            if (isWhitespace(ch))
+                return true;
+            if (m_state == State::KeyOrEnd && ch == '}')
+                return endContainer(true);
+            if (ch != '"')
+                return fail();
+            m_isKey = true;
+            m_state = State::String;
+            return true;
+
+        case State::Colon:
+            if (isWhitespace(ch))
+                return true;
+            if (ch != ':')
+                return fail();
+            m_state = State::Value;
+            return true;
+
+        case State::CommaOrEnd: {
+            if (isWhitespace(ch))
+                return true;
+            bool inObject = (m_objects >> (m_depth - 1)) & 1;
+            if (ch == ',')
+                m_state = inObject ? State::Key : State::Value;
+            else if (ch == '}' && inObject)
+                return endContainer(true);
+            else if (ch == ']' && !inObject)
+                return endContainer(false);
+            else
+                return fail();
+            return true;
+        }
+
+        case State::String:
+            if (ch != '\\')
+                flushSurrogate();
+            if (ch == '"') {
+                if (m_isKey) {
+                    emit(Token::Key, m_depth);
+                    m_state = State::Colon;
+                    return true;
+                }
+                emit(Token::String, m_depth);
+                return afterValue();
+            }
+            if (ch == '\\')
+                m_state = State::Escape;
+            else if (static_cast<uint8_t>(ch) < 0x20)
+                return fail();
+            else
+                appendToken(ch);
+            return true;
+
+        case State::Escape:
+            m_state = State::String;
+            if (ch != 'u')
+                flushSurrogate();
+            switch (ch) {
+                case '"':
+                case '\\':
+                case '/': appendToken(ch);   break;
+                case 'b': appendToken('\b'); break;
+                case 'f': appendToken('\f'); break;
+                case 'n': appendToken('\n'); break;
+                case 'r': appendToken('\r'); break;
+                case 't': appendToken('\t'); break;
+                case 'u':
+                    m_unicode = 0;
+                    m_unicodeDigits = 0;
+                    m_state = State::Unicode;
+                    break;
+                default:
+                    return fail();
+            }
+            return true;
+
+        case State::Unicode:
+            if (ch >= '0' && ch <= '9')
+                m_unicode = (m_unicode << 4) | (ch - '0');
+            else if (ch >= 'a' && ch <= 'f')
+                m_unicode = (m_unicode << 4) | (ch - 'a' + 10);
+            else if (ch >= 'A' && ch <= 'F')
+                m_unicode = (m_unicode << 4) | (ch - 'A' + 10);
+            else
+                return fail();
+            if (++m_unicodeDigits == 4) {
+                if (m_unicode >= 0xDC00 && m_unicode <= 0xDFFF && m_surrogate) {
+                    appendCodePoint(0x10000 + ((uint32_t)(m_surrogate - 0xD800) << 10) + (m_unicode - 0xDC00));
+                    m_surrogate = 0;
+                } else {
+                    flushSurrogate();
+                    if (m_unicode >= 0xD800 && m_unicode <= 0xDBFF)
+                        m_surrogate = m_unicode;
+                    else
+                        appendCodePoint(m_unicode);
+                }
+                m_state = State::String;
+            }
+            return true;
+
+        case State::Literal:
+            if (isLiteralChar(ch)) {
+                appendToken(ch);
+                return true;
+            }
+            return endLiteral() && feed(ch); // the delimiter belongs to the enclosing container
+
+        case State::Done:
+            return isWhitespace(ch) ? true : fail();
+
+        case State::Error:
+            break;
+    }
+    return false;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDJsonScanner::finish() {
+    if (m_state == State::Literal && m_depth == 0)
+        endLiteral();
+    return m_state == State::Done;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDJsonScanner::afterValue() {
+    m_state = m_depth == 0 ? State::Done : State::CommaOrEnd;
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJsonScanner::appendCodePoint(uint32_t codePoint) {
+    if (codePoint == 0 || (codePoint >= 0xD800 && codePoint <= 0xDFFF))
+        codePoint = 0xFFFD; // tokens are zero terminated, a lone surrogate is no character
+    if (codePoint < 0x80) {
+        appendToken(codePoint);
+    } else if (codePoint < 0x800) {
+        appendToken(0xC0 | (codePoint >> 6));
+        appendToken(0x80 | (codePoint & 0x3F));
+    } else if (codePoint < 0x10000) {
+        appendToken(0xE0 | (codePoint >> 12));
+        appendToken(0x80 | ((codePoint >> 6) & 0x3F));
+        appendToken(0x80 | (codePoint & 0x3F));
+    } else {
+        appendToken(0xF0 | (codePoint >> 18));
+        appendToken(0x80 | ((codePoint >> 12) & 0x3F));
+        appendToken(0x80 | ((codePoint >> 6) & 0x3F));
+        appendToken(0x80 | (codePoint & 0x3F));
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJsonScanner::appendToken(char ch) {
+    if (m_tokenLength < HSD_JSON_TOKEN_SIZE - 1)
+        m_token[m_tokenLength++] = ch;
+    else
+        m_truncated = true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJsonScanner::emit(Token token, uint8_t depth) {
+    m_token[m_tokenLength] = 0;
+    if (m_callback)
+        m_callback(token, depth, m_token, m_tokenLength);
+    m_tokenLength = 0;
+    m_truncated = false;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDJsonScanner::endContainer(bool object) {
+    m_depth--;
+    emit(object ? Token::ObjectEnd : Token::ArrayEnd, m_depth);
+    return afterValue();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDJsonScanner::endLiteral() {
+    m_token[m_tokenLength] = 0;
+    // a truncated number can only be checked by its first character
+    bool valid = strcmp(m_token, "true") == 0 || strcmp(m_token, "false") == 0 || strcmp(m_token, "null") == 0 || 
+                 (m_truncated ? m_token[0] == '-' || (m_token[0] >= '0' && m_token[0] <= '9') : isNumber(m_token));
+    if (!valid)
+        return fail();
+    emit(Token::Literal, m_depth);
+    return afterValue();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDJsonScanner::fail() {
+    m_state = State::Error;
+    return false;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJsonScanner::flushSurrogate() {
+    if (m_surrogate) {
+        appendCodePoint(m_surrogate);
+        m_surrogate = 0;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDJsonScanner::startContainer(bool object) {
+    if (m_depth >= HSD_JSON_MAX_DEPTH)
+        return fail();
+    emit(object ? Token::ObjectStart : Token::ArrayStart, m_depth);
+    if (object)
+        m_objects |= (1UL << m_depth);
+    else
+        m_objects &= ~(1UL << m_depth);
+    m_depth++;
+    m_state = object ? State::KeyOrEnd : State::ValueOrEnd;
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDJsonScanner::startValue(char ch) {
+    if (ch == '{')
+        return startContainer(true);
+    if (ch == '[')
+        return startContainer(false);
+    if (ch == '"') {
+        m_isKey = false;
+        m_state = State::String;
+        return true;
+    }
+    if (ch == '-' || (ch >= '0' && ch <= '9') || ch == 't' || ch == 'f' || ch == 'n') {
+        appendToken(ch);
+        m_state = State::Literal;
+        return true;
+    }
+    return fail();
+}
@@ -0,0 +1,81 @@
+#ifndef HSDJSONSCANNER_H
+#define HSDJSONSCANNER_H
+
+#include <Arduino.h>
+#include <functional>
+
+#define HSD_JSON_MAX_DEPTH  16
+#define HSD_JSON_TOKEN_SIZE 64
+
+/*
+ * Streaming JSON tokenizer. Data is fed byte by byte (or in blocks of any size) and every token is reported via the
+ * callback as soon as it is complete, so no document tree and no buffer for the whole payload is needed. Keys and
+ * values longer than HSD_JSON_TOKEN_SIZE - 1 are truncated, isTruncated() tells so while the token is reported.
+ * \u escapes are decoded to UTF-8 (surrogate pairs included), \u0000 and lone surrogates become U+FFFD.
+ */
+class HSDJsonScanner {
+public:
+    enum class Token : uint8_t {
+        ObjectStart = 0,
+        ObjectEnd,
+        ArrayStart,
+        ArrayEnd,
+        Key,
+        String,
+        Literal // number, true, false or null
+    };
+
+    // depth is the number of containers enclosing the token, text is zero terminated
+    typedef std::function<void(Token token, uint8_t depth, const char* text, size_t length)> Callback;
+
+    HSDJsonScanner(Callback callback);
+
+    bool        feed(char ch);
+    bool        feed(const char* data, size_t length);
+    bool        finish();
+    inline bool hasError() const { return m_state == State::Error; }
+    inline bool isComplete() const { return m_state == State::Done; }
+    inline bool isTruncated() const { return m_truncated; }
+    void        reset();
+
+private:
+    enum class State : uint8_t {
+        Value = 0,    // expecting a value
+        KeyOrEnd,     // after '{'
+        ValueOrEnd,   // after '['
+        Key,          // after ',' in an object
+        Colon,
+        CommaOrEnd,
+        String,
+        Escape,
+        Unicode,
+        Literal,
+        Done,
+        Error
+    };
+
+    bool afterValue();
+    void appendCodePoint(uint32_t codePoint);
+    void appendToken(char ch);
+    void emit(Token token, uint8_t depth);
+    bool endContainer(bool object);
+    bool endLiteral();
+    bool fail();
+    void flushSurrogate();
+    bool startContainer(bool object);
+    bool startValue(char ch);
+
+    Callback m_callback;
+    uint8_t  m_depth;
+    bool     m_isKey;
+    uint32_t m_objects;  // bit per depth: 1 = object, 0 = array
+    State    m_state;
+    uint16_t m_surrogate; // high surrogate waiting for the low one, 0 if none
+    char     m_token[HSD_JSON_TOKEN_SIZE];
+    size_t   m_tokenLength;
+    bool     m_truncated;
+    uint16_t m_unicode;
+    uint8_t  m_unicodeDigits;
+};
+
+#endif // HSDJSONSCANNER_H
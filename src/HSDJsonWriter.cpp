@@ -0,0 +1,140 @@
+#include "HSDJsonWriter.hpp"
+
+HSDJsonWriter::HSDJsonWriter(OutputCallback callback) :
+    m_bytes(0),
+    m_callback(callback),
+    m_depth(0),
+    m_empty(false),
+    m_length(0)
+{
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJsonWriter::addBool(const char* key, bool value) {
+    beginValue(key);
+    write(value ? "true" : "false");
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJsonWriter::addNumber(const char* key, long value) {
+    char text[12];
+    snprintf(text, sizeof(text), "%ld", value);
+    beginValue(key);
+    write(text);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJsonWriter::addString(const char* key, const char* value) {
+    beginValue(key);
+    writeString(value);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJsonWriter::beginArray(const char* key) {
+    beginValue(key);
+    write('[');
+    m_empty = true;
+    m_depth++;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJsonWriter::beginObject(const char* key) {
+    beginValue(key);
+    write('{');
+    m_empty = true;
+    m_depth++;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJsonWriter::beginValue(const char* key) {
+    if (m_depth > 0) {
+        if (m_empty)
+            m_empty = false;
+        else
+            write(',');
+    }
+    if (key) {
+        writeString(key);
+        write(':');
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJsonWriter::endArray() {
+    endContainer(']');
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJsonWriter::endContainer(char ch) {
+    if (m_depth > 0)
+        m_depth--;
+    m_empty = false; // the enclosing container holds the closed one
+    write(ch);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJsonWriter::endObject() {
+    endContainer('}');
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJsonWriter::flush() {
+    if (m_length == 0)
+        return;
+    m_callback(m_buffer, m_length);
+    m_bytes += m_length;
+    m_length = 0;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJsonWriter::write(char ch) {
+    if (m_length == sizeof(m_buffer))
+        flush();
+    m_buffer[m_length++] = ch;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJsonWriter::write(const char* text) {
+    while (*text)
+        write(*text++);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDJsonWriter::writeString(const char* text) {
+    // short escapes like ArduinoJson, other control characters as \u00XX, the rest as it is (UTF-8)
+    write('"');
+    for (; *text; text++) {
+        switch (*text) {
+            case '"':  write("\\\""); break;
+            case '\\': write("\\\\"); break;
+            case '\b': write("\\b"); break;
+            case '\f': write("\\f"); break;
+            case '\n': write("\\n"); break;
+            case '\r': write("\\r"); break;
+            case '\t': write("\\t"); break;
+            default:
+                if (static_cast<unsigned char>(*text) < 0x20) {
+                    char escaped[7];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(*text));
+                    write(escaped);
+                } else {
+                    write(*text);
+                }
+                break;
+        }
+    }
+    write('"');
+}
@@ -0,0 +1,46 @@
+#ifndef HSDJSONWRITER_H
+#define HSDJSONWRITER_H
+
+#include <Arduino.h>
+#include <functional>
+
+#define HSD_JSON_WRITER_BUFFER_SIZE 256 // bytes collected before they are handed to the output callback
+
+/*
+ * Streaming JSON serializer, the counterpart of HSDJsonScanner. Values are written in document order into a small
+ * buffer which is passed to the output callback whenever it is full, so the memory needed does not depend on the
+ * size of the document. Keys are ignored (nullptr) for values in arrays.
+ */
+class HSDJsonWriter {
+public:
+    typedef std::function<void(const char* data, size_t length)> OutputCallback;
+
+    HSDJsonWriter(OutputCallback callback);
+
+    void          addBool(const char* key, bool value);
+    void          addNumber(const char* key, long value);
+    void          addString(const char* key, const char* value);
+    inline void   addString(const char* key, const String& value) { addString(key, value.c_str()); }
+    void          beginArray(const char* key = nullptr);
+    void          beginObject(const char* key = nullptr);
+    void          endArray();
+    void          endObject();
+    void          flush();
+    inline size_t getBytes() const { return m_bytes + m_length; }
+
+private:
+    void          beginValue(const char* key);
+    void          endContainer(char ch);
+    void          write(char ch);
+    void          write(const char* text);
+    void          writeString(const char* text);
+
+    char           m_buffer[HSD_JSON_WRITER_BUFFER_SIZE];
+    size_t         m_bytes;    // bytes already passed to the callback
+    OutputCallback m_callback;
+    uint8_t        m_depth;
+    bool           m_empty;    // the innermost container has no value yet, the enclosing ones always have one
+    size_t         m_length;
+};
+
+#endif // HSDJSONWRITER_H
@@ -3,15 +3,42 @@
 
 #define NUMBER_OF_ELEMENTS(array)  (sizeof(array) / sizeof(array[0]))
 
+#define PIXEL_STREAM_TIMEOUT_MS    2500
+#define PIXEL_STREAM_BLOCK_SIZE    48 // bytes read at once, a multiple of 3 (RGB)
+#define PIXEL_STREAM_MAX_PACKETS   16 // packets handled per loop
+
+#define DDP_HEADER_SIZE            10
+#define DDP_FLAG_VERSION_MASK      0xC0
+#define DDP_FLAG_VERSION_1         0x40
+#define DDP_FLAG_TIMECODE          0x10
+#define DDP_FLAG_STORAGE           0x08
+#define DDP_FLAG_REPLY             0x04
+#define DDP_FLAG_QUERY             0x02
+#define DDP_FLAG_PUSH              0x01
+#define DDP_ID_DISPLAY             1
+#define DDP_ID_ALL                 255
+
 HSDLeds::HSDLeds(const HSDConfig* config) :
     m_config(config),
+    m_frameDirty(false),
+    m_frameHold(false),
+    m_frames(0),
     m_ledState(nullptr),
     m_numLeds(0),
-    m_strip(nullptr)
+    m_savedState(nullptr),
+    m_stateVersion(1),
+    m_strip(nullptr),
+    m_streamFpsStart(0),
+    m_streamFpsFrames(0),
+    m_streamLast(0),
+    m_streamSequence(0),
+    m_streaming(false),
+    m_streamUdp(nullptr)
 {
     for (uint8_t idx = 0; idx < 5; idx++)
         m_behaviorOn[idx] = true;
     m_behaviorOn[static_cast<uint8_t>(HSDConfig::Behavior::Off)] = false;
+    memset(&m_streamStats, 0, sizeof(m_streamStats));
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
@@ -19,8 +46,12 @@ HSDLeds::HSDLeds(const HSDConfig* config) :
 HSDLeds::~HSDLeds() {
     if (m_ledState)
         delete[] m_ledState;
+    if (m_savedState)
+        delete[] m_savedState;
     if (m_strip)
         delete m_strip;
+    if (m_streamUdp)
+        delete m_streamUdp;
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
@@ -34,6 +65,16 @@ void HSDLeds::begin() {
     m_strip->SetBrightness(m_config->getLedBrightness());
   
     clear();
+    if (m_config->getLedStreamPort() > 0) {
+        m_streamUdp = new WiFiUDP();
+        if (m_streamUdp->begin(m_config->getLedStreamPort())) {
+            Logger.log("Listening for pixel streams on UDP port %u", m_config->getLedStreamPort());
+        } else {
+            Logger.log("Failed to open pixel stream port %u", m_config->getLedStreamPort());
+            delete m_streamUdp;
+            m_streamUdp = nullptr;
+        }
+    }
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
@@ -46,9 +87,13 @@ bool HSDLeds::set(uint16_t ledNum, HSDConfig::Behavior behavior, uint32_t color)
         
         m_ledState[ledNum].behavior = behavior;
         m_ledState[ledNum].color = color;
+        if (m_savedState) // shown now, but also after restoreState()
+            m_savedState[ledNum] = m_ledState[ledNum];
         
-        if (update)
-            updateStripe();
+        if (update) {
+            m_frameDirty = true; // committed to the stripe with the next update()
+            m_stateVersion++;
+        }
     }
     return update;
 }
@@ -64,8 +109,10 @@ void HSDLeds::setAllOn(uint32_t color) {
         m_ledState[idx].behavior = HSDConfig::Behavior::On;
         m_ledState[idx].color = color;
     }
-    if (update)
+    if (update) {
+        m_stateVersion++;
         updateStripe();
+    }
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
@@ -82,7 +129,37 @@ HSDConfig::Behavior HSDLeds::getBehavior(uint16_t ledNum) const {
 
 // ---------------------------------------------------------------------------------------------------------------------
 
+uint32_t HSDLeds::getPixelColor(uint16_t ledNum) const {
+    // color currently on the stripe, e.g. of a stream or a blinking LED in its on phase
+    if (ledNum >= m_numLeds)
+        return LED_COLOR_NONE;
+    RgbColor color = m_strip->GetPixelColor(ledNum);
+    return (static_cast<uint32_t>(color.R) << 16) | (static_cast<uint32_t>(color.G) << 8) | color.B;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDLeds::printState(Print& out) const {
+    // 7 characters per LED: color (RRGGBB) and behavior, written in blocks of 8 LEDs
+    char block[8 * 7 + 1];
+    for (uint16_t first = 0; first < m_numLeds; first += 8) {
+        size_t length = 0;
+        for (uint16_t idx = first; idx < m_numLeds && idx < first + 8; idx++) {
+            snprintf(block + length, sizeof(block) - length, "%06X%u", m_ledState[idx].color & 0xFFFFFF, 
+                     static_cast<uint8_t>(m_ledState[idx].behavior));
+            length += 7;
+        }
+        out.write(reinterpret_cast<const uint8_t*>(block), length);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
 void HSDLeds::updateStripe() {
+    if (m_streaming) { // the stream owns the stripe, the status is shown again after the stream timed out
+        m_frameDirty = true;
+        return;
+    }
     for (uint16_t idx = 0; idx < m_numLeds; idx++) {
         if (m_behaviorOn[static_cast<uint8_t>(m_ledState[idx].behavior)])
             m_strip->SetPixelColor(idx, HtmlColor(m_ledState[idx].color));
@@ -90,6 +167,8 @@ void HSDLeds::updateStripe() {
             m_strip->SetPixelColor(idx, HtmlColor(LED_COLOR_NONE));
     }
     m_strip->Show();
+    m_frameDirty = false;
+    m_frames++;
     Logger.log("Stripe updated");
 }
 
@@ -100,20 +179,50 @@ void HSDLeds::clear() {
         m_ledState[idx].behavior = HSDConfig::Behavior::Off;
         m_ledState[idx].color = LED_COLOR_NONE;
     }
+    if (m_savedState) {
+        delete[] m_savedState;
+        m_savedState = nullptr;
+    }
+    m_stateVersion++;
     updateStripe();
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
 
+bool HSDLeds::restoreState() {
+    if (!m_savedState)
+        return false;
+    memcpy(m_ledState, m_savedState, m_numLeds * sizeof(LedState));
+    delete[] m_savedState;
+    m_savedState = nullptr;
+    m_stateVersion++;
+    m_frameDirty = true;
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDLeds::saveState() {
+    // e.g. before the disconnect color is shown, the statuses may still be valid when the connection is back
+    if (!m_savedState)
+        m_savedState = new LedState[m_numLeds];
+    memcpy(m_savedState, m_ledState, m_numLeds * sizeof(LedState));
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
 void HSDLeds::update() {
     static unsigned long prevBlink(0), prevFlash(0), prevFlicker(0);
     
+    handleStream();
+    if (m_frameHold || m_streaming)
+        return;
     unsigned long curMillis = millis();
     bool update(false);
     update |= checkCondition(HSDConfig::Behavior::Blinking, curMillis, prevBlink, 500, 500);
     update |= checkCondition(HSDConfig::Behavior::Flashing, curMillis, prevFlash, 2000, 200);
     update |= checkCondition(HSDConfig::Behavior::Flickering, curMillis, prevFlicker, 100, 100);
-    if (update)
+    if (update || m_frameDirty)
         updateStripe();
 }
 
@@ -139,6 +248,110 @@ bool HSDLeds::checkCondition(HSDConfig::Behavior behavior, unsigned long curMill
     return false;
 }
 
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDLeds::handleStream() {
+    if (!m_streamUdp)
+        return;
+
+    // a frame is usually split into several packets, read all waiting ones so the stripe does not lag behind
+    int size;
+    for (int packets = 0; packets < PIXEL_STREAM_MAX_PACKETS && (size = m_streamUdp->parsePacket()) > 0; packets++)
+        readStreamPacket(size);
+    
+    unsigned long curMillis = millis();
+    if (m_streaming && curMillis - m_streamFpsStart >= 1000) {
+        m_streamStats.fps = m_streamFpsFrames > 255 ? 255 : m_streamFpsFrames;
+        m_streamFpsFrames = 0;
+        m_streamFpsStart = curMillis;
+    }
+    if (m_streaming && curMillis - m_streamLast >= PIXEL_STREAM_TIMEOUT_MS) {
+        Logger.log("Pixel stream timed out, showing the status again");
+        m_streaming = false;
+        m_streamSequence = 0;
+        m_streamStats.fps = 0;
+        m_frameDirty = true;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDLeds::readStreamPacket(int size) {
+    uint8_t header[DDP_HEADER_SIZE + 4];
+    m_streamStats.packets++;
+    if (size < DDP_HEADER_SIZE || m_streamUdp->read(header, DDP_HEADER_SIZE) != DDP_HEADER_SIZE || 
+        (header[0] & DDP_FLAG_VERSION_MASK) != DDP_FLAG_VERSION_1) {
+        m_streamStats.malformed++;
+        return;
+    }
+    
+    uint8_t flags = header[0];
+    size_t headerSize = DDP_HEADER_SIZE;
+    if (flags & DDP_FLAG_TIMECODE) {
+        headerSize += 4;
+        if (m_streamUdp->read(header + DDP_HEADER_SIZE, 4) != 4) {
+            m_streamStats.malformed++;
+            return;
+        }
+    }
+    uint32_t offset = (uint32_t(header[4]) << 24) | (uint32_t(header[5]) << 16) | (uint32_t(header[6]) << 8) | header[7];
+    uint16_t length = (header[8] << 8) | header[9];
+    if (headerSize + length > size_t(size)) {
+        m_streamStats.malformed++;
+        return;
+    }
+    if (flags & (DDP_FLAG_QUERY | DDP_FLAG_REPLY | DDP_FLAG_STORAGE))
+        return; // queries and configuration data are not supported
+    if (header[3] != DDP_ID_DISPLAY && header[3] != DDP_ID_ALL)
+        return;
+
+    // sequence numbers run from 1 to 15, 0 means the sender does not use them
+    uint8_t sequence = header[1] & 0x0F;
+    if (sequence != 0 && m_streamSequence != 0) {
+        uint8_t expected = m_streamSequence % 15 + 1;
+        if (sequence != expected)
+            m_streamStats.dropped += (sequence + 15 - expected) % 15;
+    }
+    m_streamSequence = sequence;
+
+    unsigned long curMillis = millis();
+    if (!m_streaming) {
+        Logger.log("Pixel stream started by %s", m_streamUdp->remoteIP().toString().c_str());
+        m_streaming = true;
+        m_streamFpsFrames = 0;
+        m_streamFpsStart = curMillis;
+    }
+    m_streamLast = curMillis;
+
+    // pixels not starting at a pixel boundary (offset is counted in bytes) are skipped
+    uint32_t pixel = (offset + 2) / 3;
+    uint32_t skip = pixel * 3 - offset;
+    uint8_t block[PIXEL_STREAM_BLOCK_SIZE];
+    if (skip > length || (skip > 0 && m_streamUdp->read(block, skip) != int(skip)))
+        length = 0;
+    else
+        length -= skip;
+    while (length >= 3 && pixel < m_numLeds) {
+        size_t count = length - length % 3;
+        if (count > sizeof(block))
+            count = sizeof(block);
+        if (count > (m_numLeds - pixel) * 3)
+            count = (m_numLeds - pixel) * 3;
+        int read = m_streamUdp->read(block, count);
+        if (read <= 0)
+            break;
+        for (int idx = 0; idx + 2 < read; idx += 3)
+            m_strip->SetPixelColor(pixel++, RgbColor(block[idx], block[idx + 1], block[idx + 2]));
+        length -= read;
+    }
+    
+    if (flags & DDP_FLAG_PUSH) {
+        m_strip->Show();
+        m_streamStats.frames++;
+        m_streamFpsFrames++;
+    }
+}
+
 // ---------------------------------------------------------------------------------------------------------------------
 #ifdef MQTT_TEST_TOPIC
 void HSDLeds::test(uint32_t type) {
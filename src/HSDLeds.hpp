@@ -2,6 +2,7 @@
 #define HSDLEDS
 
 #include <NeoPixelBrightnessBus.h>
+#include <WiFiUdp.h>
 
 #include "HSDConfig.hpp"
 
@@ -12,8 +13,21 @@
 #define LED_COLOR_RED     0xFF0000
 #define LED_COLOR_YELLOW  0xFFCC00
 
+/*
+ * Shows the status of the devices on the stripe. With a stream port configured, frames sent by a host using the DDP
+ * protocol (http://www.3waylabs.com/ddp/) are written directly into the stripe buffer instead. The status is shown
+ * again when no stream packet was received for PIXEL_STREAM_TIMEOUT_MS.
+ */
 class HSDLeds {
 public:  
+    struct StreamStats {
+        uint32_t dropped;   // packets missing in the sequence numbering
+        uint8_t  fps;       // frames shown during the last second
+        uint32_t frames;
+        uint32_t malformed;
+        uint32_t packets;
+    };
+
     HSDLeds(const HSDConfig* config);
     ~HSDLeds();
 
@@ -21,6 +35,16 @@ public:
     void                clear();
     uint32_t            getColor(uint16_t ledNum) const;
     HSDConfig::Behavior getBehavior(uint16_t ledNum) const;
+    inline uint32_t     getFrames() const { return m_frames; }
+    uint32_t            getPixelColor(uint16_t ledNum) const;
+    inline uint32_t     getStateVersion() const { return m_stateVersion; }
+    inline const StreamStats& getStreamStats() const { return m_streamStats; }
+    inline void         holdFrame(bool hold) { m_frameHold = hold; }
+    inline bool         isStreaming() const { return m_streaming; }
+    void                printState(Print& out) const;
+    inline size_t       printStateLength() const { return m_numLeds * 7; }
+    bool                restoreState();
+    void                saveState();
     bool                set(uint16_t ledNum, HSDConfig::Behavior behavior, uint32_t color);
     void                setAllOn(uint32_t color);
 #ifdef MQTT_TEST_TOPIC    
@@ -35,14 +59,27 @@ private:
     };
 
     bool checkCondition(HSDConfig::Behavior behavior, unsigned long curMillis, unsigned long& prev, uint32_t offTime, uint32_t onTime);
+    void handleStream();
+    void readStreamPacket(int size);
     void updateStripe();
   
     bool                                                    m_behaviorOn[5];
     const HSDConfig*                                        m_config;
+    bool                                                    m_frameDirty;
+    bool                                                    m_frameHold;
+    uint32_t                                                m_frames;           // status frames shown on the stripe
     LedState*                                               m_ledState;
     uint16_t                                                m_numLeds;
+    LedState*                                               m_savedState;       // statuses hidden by setAllOn(), see saveState()
+    uint32_t                                                m_stateVersion;     // incremented whenever an LED status changes
     NeoPixelBrightnessBus<NeoGrbFeature, Neo800KbpsMethod>* m_strip;
-
+    unsigned long                                           m_streamFpsStart;   // start of the current fps interval
+    uint32_t                                                m_streamFpsFrames;  // frames shown in the current interval
+    unsigned long                                           m_streamLast;       // time of the last stream packet
+    uint8_t                                                 m_streamSequence;   // 0 if the sender does not number its packets
+    StreamStats                                             m_streamStats;
+    bool                                                    m_streaming;
+    WiFiUDP*                                                m_streamUdp;        // only exists with a stream port configured
 };
 
 #endif // HSDLEDS
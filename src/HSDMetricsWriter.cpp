@@ -0,0 +1,85 @@
+#include "HSDMetricsWriter.hpp"
+
+#include <math.h>
+
+HSDMetricsWriter::HSDMetricsWriter(OutputCallback callback) :
+    m_bytes(0),
+    m_callback(callback),
+    m_length(0)
+{
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMetricsWriter::addCounter(const char* name, const char* help, uint32_t value) {
+    addMetric(name, "counter", help);
+    addSample(name, value);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMetricsWriter::addGauge(const char* name, const char* help, double value) {
+    addMetric(name, "gauge", help);
+    addSample(name, value);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMetricsWriter::addMetric(const char* name, const char* type, const char* help) {
+    write("# HELP ");
+    write(name);
+    write(' ');
+    write(help);
+    write("\n# TYPE ");
+    write(name);
+    write(' ');
+    write(type);
+    write('\n');
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMetricsWriter::addSample(const char* name, double value, const char* labels) {
+    // counters and most gauges are integers, they are written without decimals
+    char text[24];
+    if (isnan(value))
+        strcpy(text, "NaN");
+    else if (value == floor(value) && fabs(value) < 1e15)
+        snprintf(text, sizeof(text), "%.0f", value);
+    else
+        snprintf(text, sizeof(text), "%g", value);
+    write(name);
+    if (labels) {
+        write('{');
+        write(labels);
+        write('}');
+    }
+    write(' ');
+    write(text);
+    write('\n');
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMetricsWriter::flush() {
+    if (m_length == 0)
+        return;
+    m_callback(m_buffer, m_length);
+    m_bytes += m_length;
+    m_length = 0;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMetricsWriter::write(char ch) {
+    if (m_length == sizeof(m_buffer))
+        flush();
+    m_buffer[m_length++] = ch;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMetricsWriter::write(const char* text) {
+    while (*text)
+        write(*text++);
+}
@@ -0,0 +1,37 @@
+#ifndef HSDMETRICSWRITER_H
+#define HSDMETRICSWRITER_H
+
+#include <Arduino.h>
+#include <functional>
+
+#define HSD_METRICS_WRITER_BUFFER_SIZE 256 // bytes collected before they are handed to the output callback
+
+/*
+ * Streaming writer of the Prometheus text exposition format. Like HSDJsonWriter, the output is collected in a small
+ * buffer which is passed to the output callback whenever it is full. Metrics with several samples (labels) are
+ * written with addMetric() followed by addSample() per sample, labels are given as e.g. source="mqtt".
+ */
+class HSDMetricsWriter {
+public:
+    typedef std::function<void(const char* data, size_t length)> OutputCallback;
+
+    HSDMetricsWriter(OutputCallback callback);
+
+    void          addCounter(const char* name, const char* help, uint32_t value);
+    void          addGauge(const char* name, const char* help, double value);
+    void          addMetric(const char* name, const char* type, const char* help);
+    void          addSample(const char* name, double value, const char* labels = nullptr);
+    void          flush();
+    inline size_t getBytes() const { return m_bytes + m_length; }
+
+private:
+    void           write(char ch);
+    void           write(const char* text);
+
+    char           m_buffer[HSD_METRICS_WRITER_BUFFER_SIZE];
+    size_t         m_bytes;    // bytes already passed to the callback
+    OutputCallback m_callback;
+    size_t         m_length;
+};
+
+#endif // HSDMETRICSWRITER_H
@@ -1,39 +1,188 @@
 #include "HSDMqtt.hpp"
 #include "HSDLogger.hpp"
 
+#ifdef ESP32
+#include <lwip/tcpip.h>
+#endif
+
+#define BACKOFF_MIN_MILLIS     1000  // delay after the first failed connect attempt, doubled with every failure ...
+#define BACKOFF_MAX_MILLIS     60000 // ... up to this limit
+#define CONNACK_TIMEOUT_SEC    3     // PubSubClient waits this long for the broker to answer
+#define DNS_TIMEOUT_MILLIS     10000
+#define QUEUE_DRAIN_MILLIS     100   // send at most one queued message in this time
+#define SYNC_QUIET_MILLIS      1000  // sync phase ends if no message was received for this time
+#define SYNC_MAX_MILLIS        15000 // ... but lasts not longer than this
+#define TCP_CONNECT_TIMEOUT_MS 1000
+
+// for placeholders 
+using namespace std::placeholders; 
+
+static uint32_t hardwareRandom() {
+#ifdef ESP32
+    return esp_random();
+#elif defined(ESP8266)
+    return RANDOM_REG32;
+#else
+    return random(0x7FFFFFFF);
+#endif
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void onDnsFound(const char* name, const ip_addr_t* ipaddr, void* arg) {
+    // called from the lwIP context
+    HSDMqtt* mqtt = reinterpret_cast<HSDMqtt*>(arg);
+    mqtt->m_dnsAddress = ipaddr ? ip4_addr_get_u32(ip_2_ip4(ipaddr)) : 0;
+    mqtt->m_dnsDone = true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
 HSDMqtt::HSDMqtt(const HSDConfig* config, MQTT_CALLBACK_SIGNATURE) :
+    m_callback(callback),
     m_config(config),
-    m_pubSubClient(new PubSubClient(m_wifiClient))
+    m_connectAttempts(0),
+    m_connectDelay(0),
+    m_connectDurationLast(0),
+    m_connectDurationMax(0),
+    m_connectFailures(0),
+    m_connects(0),
+    m_connectStart(0),
+    m_connectState(ConnectState::Idle),
+    m_dnsAddress(0),
+    m_dnsDone(false),
+    m_messages(0),
+    m_published(0),
+    m_pubSubClient(new PubSubClient(m_mqttClient)),
+    m_queue(new HSDMqttQueue()),
+    m_queueDrainDuration(0),
+    m_queueDrainLast(0),
+    m_queueDrainStart(0),
+    m_queueDraining(false),
+    m_sessionResumed(false),
+    m_streamMessages(0),
+    m_streamSkipped(0),
+    m_syncActive(false),
+    m_syncDuration(0),
+    m_syncLastMessage(0),
+    m_syncMessages(0),
+    m_syncStart(0)
 {
-    m_pubSubClient->setCallback(callback);
+    m_pubSubClient->setCallback(std::bind(&HSDMqtt::onMessage, this, _1, _2, _3));
+    m_mqttClient.setStreamHandler(MQTT_MAX_PACKET_SIZE, std::bind(&HSDMqtt::onStreamBegin, this, _1, _2), 
+                                  std::bind(&HSDMqtt::onStreamData, this, _1, _2), 
+                                  std::bind(&HSDMqtt::onStreamEnd, this, _1));
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
 
 void HSDMqtt::begin() {  
-    IPAddress mqttIpAddr;
-    if (mqttIpAddr.fromString(m_config->getMqttServer())) // valid ip address entered 
-        m_pubSubClient->setServer(mqttIpAddr, m_config->getMqttPort()); 
-     else                                                // invalid ip address, try as hostname
-        m_pubSubClient->setServer(m_config->getMqttServer().c_str(), m_config->getMqttPort());
+    Logger.log("Using MQTT broker %s:%u", m_config->getMqttServer().c_str(), m_config->getMqttPort());
+    m_pubSubClient->setSocketTimeout(CONNACK_TIMEOUT_SEC);
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
 
 void HSDMqtt::handle() {
-    static bool first = true;
-    static unsigned long millisLastConnectTry = 0;
-    
     if (WiFi.isConnected()) {
         if (m_pubSubClient->connected()) {
             if (!m_pubSubClient->loop()) 
                 Logger.log("Mqtt disconnected - state=%d", m_pubSubClient->state());
+            if (m_syncActive && (millis() - m_syncLastMessage >= SYNC_QUIET_MILLIS || millis() - m_syncStart >= SYNC_MAX_MILLIS)) {
+                m_syncActive = false;
+                m_syncDuration = m_syncLastMessage - m_syncStart;
+                Logger.log("Mqtt sync finished: %u messages in %lu ms", m_syncMessages, m_syncDuration);
+            }
+            drainQueue();
         } else {
-            if (first || ((millis() - millisLastConnectTry) >= 10000)) { // alle 10 Sekunden testen
-                Logger.log("Mqtt not connected (state=%d)", m_pubSubClient->state());
-                first = false;
-                millisLastConnectTry = millis();
-                reconnect();
+            m_syncActive = false;
+            handleConnect();
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMqtt::handleConnect() {
+    switch (m_connectState) {
+        case ConnectState::Connected: {
+            // connection lost: reconnect soon, but spread the attempts of all displays after a broker restart
+            Logger.log("Mqtt connection lost (state=%d)", m_pubSubClient->state());
+            m_connectFailures = 0;
+            m_connectDelay = hardwareRandom() % BACKOFF_MIN_MILLIS;
+            m_connectStart = millis();
+            m_connectState = ConnectState::Idle;
+            break;
+        }
+
+        case ConnectState::Idle:
+            if (millis() - m_connectStart >= m_connectDelay)
+                startConnect();
+            break;
+
+        case ConnectState::Resolving:
+            if (m_dnsDone) {
+                if (m_dnsAddress != 0)
+                    connectBroker(IPAddress(m_dnsAddress));
+                else
+                    connectFailed("DNS lookup failed");
+            } else if (millis() - m_connectStart >= DNS_TIMEOUT_MILLIS) {
+                connectFailed("DNS lookup timed out");
+            }
+            break;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMqtt::startConnect() {
+    m_connectAttempts++;
+    m_connectStart = millis();
+    IPAddress ip;
+    if (ip.fromString(m_config->getMqttServer())) { // valid ip address entered
+        connectBroker(ip);
+        return;
+    }
+    
+    // invalid ip address, resolve as hostname without blocking the loop
+    ip_addr_t addr;
+    m_dnsDone = false;
+#if defined(ESP32) && LWIP_TCPIP_CORE_LOCKING
+    LOCK_TCPIP_CORE();
+#endif
+    err_t err = dns_gethostbyname(m_config->getMqttServer().c_str(), &addr, onDnsFound, this);
+#if defined(ESP32) && LWIP_TCPIP_CORE_LOCKING
+    UNLOCK_TCPIP_CORE();
+#endif
+    if (err == ERR_OK) // cached
+        connectBroker(IPAddress(ip4_addr_get_u32(ip_2_ip4(&addr))));
+    else if (err == ERR_INPROGRESS)
+        m_connectState = ConnectState::Resolving;
+    else
+        connectFailed("DNS lookup failed");
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMqtt::connectBroker(const IPAddress& ip) {
+    if (!m_mqttClient.connect(ip, m_config->getMqttPort(), TCP_CONNECT_TIMEOUT_MS)) {
+        connectFailed("TCP connect failed");
+    } else {
+        // PubSubClient uses the already open connection and only sends CONNECT
+        m_pubSubClient->setServer(ip, m_config->getMqttPort());
+        if (!startSession()) {
+            m_mqttClient.stop();
+            connectFailed("MQTT connect failed");
+        } else {
+            m_connectDurationLast = millis() - m_connectStart;
+            if (m_connectDurationLast > m_connectDurationMax)
+                m_connectDurationMax = m_connectDurationLast;
+            m_connectFailures = 0;
+            m_connectState = ConnectState::Connected;
+            if (!m_queue->isEmpty()) {
+                Logger.log("Sending %u queued messages", m_queue->getDepth());
+                m_queueDraining = true;
+                m_queueDrainStart = millis();
             }
         }
     }
@@ -41,7 +190,49 @@ void HSDMqtt::handle() {
 
 // ---------------------------------------------------------------------------------------------------------------------
 
-bool HSDMqtt::reconnect() const {
+void HSDMqtt::connectFailed(const char* reason) {
+    m_connectDurationLast = millis() - m_connectStart;
+    if (m_connectDurationLast > m_connectDurationMax)
+        m_connectDurationMax = m_connectDurationLast;
+    
+    // exponential backoff with jitter: wait between half and the full backoff time
+    unsigned long backoff = m_connectFailures < 7 ? BACKOFF_MIN_MILLIS << m_connectFailures : BACKOFF_MAX_MILLIS;
+    if (backoff > BACKOFF_MAX_MILLIS)
+        backoff = BACKOFF_MAX_MILLIS;
+    m_connectFailures++;
+    m_connectDelay = backoff / 2 + hardwareRandom() % (backoff / 2 + 1);
+    m_connectStart = millis();
+    m_connectState = ConnectState::Idle;
+    Logger.log("Failed to connect to MQTT broker %s:%d - %s (rc=%d, %lu ms), next try in %lu ms", 
+               m_config->getMqttServer().c_str(), m_config->getMqttPort(), reason, m_pubSubClient->state(), 
+               m_connectDurationLast, m_connectDelay);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMqtt::reconnect() {
+    m_pubSubClient->disconnect();
+    m_connectDelay = 0;
+    m_connectFailures = 0;
+    m_connectStart = millis();
+    m_connectState = ConnectState::Idle;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMqtt::resubscribe() {
+    // the statuses shown were dropped, so the retained messages are needed again even for a resumed session
+    m_sessionResumed = false;
+    m_subscribedTopics = "";
+    if (!m_pubSubClient->connected())
+        return; // subscribed with the next session
+    subscribeStatusTopics();
+    startSync();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDMqtt::startSession() {
     bool retval(false), connected(false);
   
     // Create a constant but unique client ID
@@ -51,23 +242,19 @@ bool HSDMqtt::reconnect() const {
     snprintf(clientId, 24, "%s-%s", m_config->getHost().c_str(), mac.substring(6).c_str());
 
     const String& willTopic = m_config->getMqttOutTopic("status");
-    m_pubSubClient->disconnect();
-    if (m_config->getMqttUser().length() == 0) {
-        if (isTopicValid(willTopic))
-            connected = m_pubSubClient->connect(clientId, willTopic.c_str(), 0, true, "offline");
-        else
-            connected = m_pubSubClient->connect(clientId);
-    } else {
-        if (isTopicValid(willTopic))
-            connected = m_pubSubClient->connect(clientId, m_config->getMqttUser().c_str(), m_config->getMqttPassword().c_str(), willTopic.c_str(), 0, true, "off");
-        else
-            connected = m_pubSubClient->connect(clientId, m_config->getMqttUser().c_str(), m_config->getMqttPassword().c_str());
-    }
+    bool persistent = m_config->getMqttPersistentSession();
+    connected = m_pubSubClient->connect(clientId, 
+                                        m_config->getMqttUser().length() > 0 ? m_config->getMqttUser().c_str() : nullptr,
+                                        m_config->getMqttUser().length() > 0 ? m_config->getMqttPassword().c_str() : nullptr,
+                                        isTopicValid(willTopic) ? willTopic.c_str() : nullptr, 0, true, "offline", !persistent);
     if (connected) {
-        Logger.log("Connected to MQTT broker %s:%d with clientId %s", m_config->getMqttServer().c_str(), 
-                   m_config->getMqttPort(), clientId);
+        m_connects++;
+        Logger.log("Connected to MQTT broker %s:%d with clientId %s (%s session%s)", m_config->getMqttServer().c_str(), 
+                   m_config->getMqttPort(), clientId, persistent ? "persistent" : "clean", 
+                   m_mqttClient.sessionPresent() ? " resumed" : "");
+        // bypass the queue, these must be sent before any queued message
         if (isTopicValid(willTopic))
-            publish(willTopic, "online");
+            send(willTopic.c_str(), "online");
         String verTopic = m_config->getMqttOutTopic("versions");
         if (isTopicValid(verTopic)) {
             DynamicJsonBuffer jsonBuffer;
@@ -77,12 +264,22 @@ bool HSDMqtt::reconnect() const {
             json["CoreVersion"] = ESP.getCoreVersion();
 #endif            
             json["SdkVersion"] = ESP.getSdkVersion();
-            publish(verTopic, json);
+            String jsonStr;
+            json.printTo(jsonStr);
+            send(verTopic.c_str(), jsonStr.c_str());
         }
-        subscribe(m_config->getMqttStatusTopic());
+        String topics = m_config->getMqttStatusTopic();
 #ifdef MQTT_TEST_TOPIC  
-        subscribe(m_config->getMqttTestTopic());
+        topics += "\n" + m_config->getMqttTestTopic();
 #endif // MQTT_TEST_TOPIC  
+        m_sessionResumed = persistent && m_mqttClient.sessionPresent() && topics == m_subscribedTopics;
+        if (m_sessionResumed) {
+            // the broker kept the subscriptions, resubscribing would replay all retained messages
+            Logger.log("Subscriptions kept by broker, only changes are delivered");
+        } else {
+            subscribeStatusTopics();
+        }
+        startSync();
         retval = true;
     } else {
         Logger.log("Failed to connect to MQTT broker %s:%d, rc=%d", m_config->getMqttServer().c_str(), 
@@ -93,33 +290,167 @@ bool HSDMqtt::reconnect() const {
 
 // ---------------------------------------------------------------------------------------------------------------------
 
-void HSDMqtt::subscribe(const String& topic) const {
+void HSDMqtt::startSync() {
+    // the broker now sends all retained or queued messages at once, collect them without rendering each one
+    m_syncActive = true;
+    m_syncMessages = 0;
+    m_syncStart = m_syncLastMessage = millis();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMqtt::onMessage(char* topic, uint8_t* payload, unsigned int length) {
+    m_messages++;
+    if (m_syncActive) {
+        m_syncMessages++;
+        m_syncLastMessage = millis();
+    }
+    if (m_callback)
+        m_callback(topic, payload, length);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDMqtt::onStreamBegin(const char* topic, uint32_t length) {
+    if (m_syncActive) {
+        m_syncMessages++;
+        m_syncLastMessage = millis();
+    }
+    if (m_mqttClient.isStreamTopicTruncated()) {
+        m_streamSkipped++;
+        Logger.log("Skipped large message for topic %s... (topic longer than %u bytes)", topic, 
+                   HSD_MQTT_STREAM_TOPIC_SIZE - 1);
+        return false;
+    }
+    if (length > m_config->getMqttMaxPayload() || !m_streamBegin || !m_streamBegin(topic, length)) {
+        m_streamSkipped++;
+        Logger.log("Skipped large message for topic %s (%u bytes, limit %u)", topic, length, 
+                   m_config->getMqttMaxPayload());
+        return false;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMqtt::onStreamData(const uint8_t* data, size_t length) {
+    if (m_streamData)
+        m_streamData(data, length);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMqtt::onStreamEnd(bool complete) {
+    if (complete)
+        m_streamMessages++;
+    else
+        m_streamSkipped++;
+    if (m_syncActive)
+        m_syncLastMessage = millis();
+    if (m_streamEnd)
+        m_streamEnd(complete);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMqtt::setStreamCallbacks(HSDMqttClient::StreamBegin begin, HSDMqttClient::StreamData data, 
+                                 HSDMqttClient::StreamEnd end) {
+    m_streamBegin = begin;
+    m_streamData = data;
+    m_streamEnd = end;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMqtt::subscribe(const String& topic, uint8_t qos) const {
     if (isTopicValid(topic)) {
-        if (!m_pubSubClient->subscribe(topic.c_str()))
+        if (!m_pubSubClient->subscribe(topic.c_str(), qos))
             Logger.log("Failed to subscribe to topic %s", topic.c_str());
         else
-            Logger.log("Subscribed to topic %s", topic.c_str());
+            Logger.log("Subscribed to topic %s (QoS %u)", topic.c_str(), qos);
     }
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
 
-void HSDMqtt::publish(const String& topic, String msg) const {
-    if (connected()) {
-        if (m_pubSubClient->publish(topic.c_str(), msg.c_str()))
-            Logger.log("Published msg %s for topic %s (free RAM %u)", msg.c_str(), topic.c_str(), ESP.getFreeHeap());
-        else
-            Logger.log("Error publishing msg %s for topic %s (free RAM %u) - rc: %d", msg.c_str(), topic.c_str(), 
-                       ESP.getFreeHeap(), m_pubSubClient->state());
+void HSDMqtt::subscribeStatusTopics() {
+    if (m_statusTopics.getSource() != m_config->getMqttStatusTopic() && 
+        !m_statusTopics.build(m_config->getMqttStatusTopic()))
+        Logger.log("Invalid status topic filters ignored in %s", m_config->getMqttStatusTopic().c_str());
+    uint8_t qos = m_config->getMqttPersistentSession() ? 1 : 0;
+    for (size_t idx = 0; idx < m_statusTopics.getFilterCount(); idx++)
+        subscribe(m_statusTopics.getFilter(idx), qos);
+    m_subscribedTopics = m_config->getMqttStatusTopic();
+#ifdef MQTT_TEST_TOPIC  
+    subscribe(m_config->getMqttTestTopic(), qos);
+    m_subscribedTopics += "\n" + m_config->getMqttTestTopic();
+#endif // MQTT_TEST_TOPIC  
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMqtt::drainQueue() {
+    if (m_queue->isEmpty() || millis() - m_queueDrainLast < QUEUE_DRAIN_MILLIS)
+        return;
+    
+    m_queueDrainLast = millis();
+    if (send(m_queue->frontTopic(), m_queue->frontPayload()))
+        m_queue->pop();
+    if (m_queue->isEmpty() && m_queueDraining) {
+        m_queueDraining = false;
+        m_queueDrainDuration = millis() - m_queueDrainStart;
+        Logger.log("Publish queue drained in %lu ms", m_queueDrainDuration);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDMqtt::send(const char* topic, const char* msg) const {
+    bool retval = m_pubSubClient->publish(topic, msg);
+    if (retval) {
+        m_published++;
+        Logger.log("Published msg %s for topic %s (free RAM %u)", msg, topic, ESP.getFreeHeap());
     } else {
-        Logger.log("Not connected - failed to publish msg %s for topic %s", msg.c_str(), topic.c_str());
+        Logger.log("Error publishing msg %s for topic %s (free RAM %u) - rc: %d", msg, topic, ESP.getFreeHeap(), 
+                   m_pubSubClient->state());
     }
+    return retval;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMqtt::publish(const String& topic, String msg, bool coalesce) const {
+    // messages wait in the queue while older ones are still pending, so the order is kept
+    if (connected() && m_queue->isEmpty() && send(topic.c_str(), msg.c_str()))
+        return;
+    
+    if (m_queue->push(topic.c_str(), msg.c_str(), coalesce))
+        Logger.log("Queued msg %s for topic %s (%u queued)", msg.c_str(), topic.c_str(), m_queue->getDepth());
+    else
+        Logger.log("Message too large for queue - dropped msg %s for topic %s", msg.c_str(), topic.c_str());
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
 
-void HSDMqtt::publish(const String& topic, const JsonObject& json) const {
+void HSDMqtt::publish(const String& topic, const JsonObject& json, bool coalesce) const {
     String jsonStr;
     json.printTo(jsonStr);
-    publish(topic, jsonStr);
+    publish(topic, jsonStr, coalesce);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDMqtt::publishRetained(const String& topic, size_t length, PayloadWriter writer) const {
+    // the payload is written directly to the connection, so it may be larger than the PubSubClient buffer
+    if (!connected() || !m_pubSubClient->beginPublish(topic.c_str(), length, true))
+        return false;
+    writer(*m_pubSubClient);
+    bool retval = m_pubSubClient->endPublish();
+    if (retval) {
+        m_published++;
+        Logger.log("Published %u bytes for topic %s (retained)", length, topic.c_str());
+    } else {
+        Logger.log("Error publishing %u bytes for topic %s - rc: %d", length, topic.c_str(), m_pubSubClient->state());
+    }
+    return retval;
 }
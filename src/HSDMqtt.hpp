@@ -6,6 +6,7 @@
 
 #include <ArduinoJson.h>
 #include <PubSubClient.h>
+#include <lwip/dns.h>
 #ifdef ESP32
 #include <WiFi.h>
 #elif defined(ESP8266)
@@ -13,25 +14,101 @@
 #endif
 
 #include "HSDConfig.hpp"
+#include "HSDMqttClient.hpp"
+#include "HSDMqttQueue.hpp"
+#include "HSDTopicTrie.hpp"
 
 class HSDMqtt {
 public:
+    typedef std::function<void(Print& out)> PayloadWriter;
+
     HSDMqtt(const HSDConfig* config, MQTT_CALLBACK_SIGNATURE);
 
-    void        begin();
-    inline bool connected() const { return m_pubSubClient->connected(); }
-    void        handle();
-    inline bool isTopicValid(const String& topic) const { return topic.length() > 0; }
-    void        publish(const String& topic, String msg) const;
-    void        publish(const String& topic, const JsonObject& json) const;
-    bool        reconnect() const; 
+    void                 begin();
+    inline bool          connected() const { return m_pubSubClient->connected(); }
+    inline unsigned int  getConnectAttempts() const { return m_connectAttempts; }
+    inline unsigned long getConnectDurationLast() const { return m_connectDurationLast; }
+    inline unsigned long getConnectDurationMax() const { return m_connectDurationMax; }
+    inline unsigned int  getConnects() const { return m_connects; }
+    inline unsigned int  getMessages() const { return m_messages; }
+    inline unsigned int  getPublished() const { return m_published; }
+    inline const HSDMqttQueue& getQueue() const { return *m_queue; }
+    inline unsigned long getQueueDrainDuration() const { return m_queueDrainDuration; }
+    inline unsigned int  getStreamMessages() const { return m_streamMessages; }
+    inline unsigned int  getStreamSkipped() const { return m_streamSkipped; }
+    inline unsigned long getSyncDuration() const { return m_syncDuration; }
+    inline unsigned int  getSyncMessages() const { return m_syncMessages; }
+    void                 handle();
+    inline bool          isSessionResumed() const { return m_sessionResumed; }
+    inline bool          isSyncing() const { return m_syncActive; }
+    inline bool          isTopicValid(const String& topic) const { return topic.length() > 0; }
+    inline int           matchStatusTopic(const char* topic, String& device) const { return m_statusTopics.match(topic, device); }
+    void                 publish(const String& topic, String msg, bool coalesce = false) const;
+    void                 publish(const String& topic, const JsonObject& json, bool coalesce = false) const;
+    bool                 publishRetained(const String& topic, size_t length, PayloadWriter writer) const;
+    void                 reconnect(); 
+    void                 resubscribe();
+    void                 setStreamCallbacks(HSDMqttClient::StreamBegin begin, HSDMqttClient::StreamData data, 
+                                            HSDMqttClient::StreamEnd end);
 
 private:
-    void subscribe(const String& topic) const;
+    enum class ConnectState : uint8_t {
+        Idle = 0,  // waiting for the next connect attempt
+        Resolving, // waiting for the DNS lookup of the broker
+        Connected
+    };
+
+    void connectBroker(const IPAddress& ip);
+    void connectFailed(const char* reason);
+    void drainQueue();
+    void handleConnect();
+    void onMessage(char* topic, uint8_t* payload, unsigned int length);
+    bool onStreamBegin(const char* topic, uint32_t length);
+    void onStreamData(const uint8_t* data, size_t length);
+    void onStreamEnd(bool complete);
+    bool send(const char* topic, const char* msg) const;
+    bool startSession();
+    void startConnect();
+    void startSync();
+    void subscribe(const String& topic, uint8_t qos) const;
+    void subscribeStatusTopics();
 
+    std::function<void(char*, uint8_t*, unsigned int)> m_callback;
     const HSDConfig*      m_config;
+    unsigned int          m_connectAttempts;
+    unsigned long         m_connectDelay;    // backoff until the next attempt
+    unsigned long         m_connectDurationLast;
+    unsigned long         m_connectDurationMax;
+    unsigned int          m_connectFailures; // consecutive failed attempts
+    unsigned int          m_connects;        // sessions established
+    unsigned long         m_connectStart;
+    ConnectState          m_connectState;
+    volatile uint32_t     m_dnsAddress;
+    volatile bool         m_dnsDone;
+    unsigned int          m_messages;     // messages received, without the streamed ones
+    HSDMqttClient         m_mqttClient;
+    mutable unsigned int  m_published;
     mutable PubSubClient* m_pubSubClient;
-    WiFiClient            m_wifiClient;  
+    HSDMqttQueue*         m_queue;        // messages published while the broker was not reachable
+    unsigned long         m_queueDrainDuration;
+    unsigned long         m_queueDrainLast;
+    unsigned long         m_queueDrainStart;
+    bool                  m_queueDraining;
+    bool                  m_sessionResumed; // the broker kept the subscriptions, only changes are delivered
+    HSDTopicTrie          m_statusTopics; // subscribed status topic filters
+    HSDMqttClient::StreamBegin m_streamBegin; // receives messages too large for the PubSubClient buffer
+    HSDMqttClient::StreamData  m_streamData;
+    HSDMqttClient::StreamEnd   m_streamEnd;
+    unsigned int          m_streamMessages;
+    unsigned int          m_streamSkipped;
+    String                m_subscribedTopics; // subscriptions the broker keeps for a persistent session
+    bool                  m_syncActive;   // retained messages are flooding in after (re)subscribing
+    unsigned long         m_syncDuration;
+    unsigned long         m_syncLastMessage;
+    unsigned int          m_syncMessages;
+    unsigned long         m_syncStart;
+
+friend void onDnsFound(const char* name, const ip_addr_t* ipaddr, void* arg);
 };
 
 #endif // HSDMQTT_H
@@ -0,0 +1,242 @@
+#include "HSDMqttClient.hpp"
+
+#define MQTT_PACKET_CONNACK 2
+#define MQTT_PACKET_PUBLISH 3
+#define MQTT_PACKET_PUBACK  4
+
+HSDMqttClient::HSDMqttClient() :
+    m_sessionPresent(false),
+    m_streamAccepted(false),
+    m_streamPacketId(0),
+    m_streamPayloadStart(0),
+    m_streaming(false),
+    m_streamThreshold(0),
+    m_streamTopicLength(0),
+    m_streamWindowLength(0)
+{
+    resetFrame();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+int HSDMqttClient::available() {
+    return m_client.available();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+int HSDMqttClient::connect(IPAddress ip, uint16_t port) {
+    resetFrame();
+    m_sessionPresent = false;
+    return m_client.connect(ip, port);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+int HSDMqttClient::connect(const char* host, uint16_t port) {
+    resetFrame();
+    m_sessionPresent = false;
+    return m_client.connect(host, port);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+int HSDMqttClient::connect(IPAddress ip, uint16_t port, int timeout) {
+    resetFrame();
+    m_sessionPresent = false;
+#ifdef ESP32
+    return m_client.connect(ip, port, timeout);
+#else
+    m_client.setTimeout(timeout); // used as connect timeout by the ESP8266 core
+    return m_client.connect(ip, port);
+#endif
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+#ifdef ESP32
+int HSDMqttClient::connect(const char* host, uint16_t port, int timeout) {
+    resetFrame();
+    m_sessionPresent = false;
+    return m_client.connect(host, port, timeout);
+}
+#endif // ESP32
+// ---------------------------------------------------------------------------------------------------------------------
+
+uint8_t HSDMqttClient::connected() {
+    return m_client.connected();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMqttClient::flush() {
+    m_client.flush();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+HSDMqttClient::operator bool() {
+    return m_client;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+int HSDMqttClient::peek() {
+    return m_client.peek();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+int HSDMqttClient::read() {
+    int data = m_client.read();
+    if (data >= 0)
+        observe(data);
+    return data;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+int HSDMqttClient::read(uint8_t* buf, size_t size) {
+    int res = m_client.read(buf, size);
+    for (int idx = 0; idx < res; idx++)
+        observe(buf[idx]);
+    return res;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMqttClient::setStreamHandler(size_t threshold, StreamBegin begin, StreamData data, StreamEnd end) {
+    m_streamThreshold = threshold;
+    m_streamBegin = begin;
+    m_streamData = data;
+    m_streamEnd = end;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMqttClient::stop() {
+    m_client.stop();
+    resetFrame();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+size_t HSDMqttClient::write(uint8_t data) {
+    return m_client.write(data);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+size_t HSDMqttClient::write(const uint8_t* buf, size_t size) {
+    return m_client.write(buf, size);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMqttClient::endStream(bool complete) {
+    if (m_streamAccepted) {
+        if (m_streamWindowLength > 0 && m_streamData)
+            m_streamData(m_streamWindow, m_streamWindowLength);
+        if (m_streamEnd)
+            m_streamEnd(complete);
+    }
+    m_streamAccepted = false;
+    m_streaming = false;
+    m_streamWindowLength = 0;
+    
+    // PubSubClient ignores the packet, so it does not acknowledge it either
+    if (complete && (m_frameFlags & 0x06) != 0) {
+        uint8_t puback[4] = { MQTT_PACKET_PUBACK << 4, 2, static_cast<uint8_t>(m_streamPacketId >> 8), 
+                              static_cast<uint8_t>(m_streamPacketId & 0xFF) };
+        m_client.write(puback, 4);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMqttClient::observe(uint8_t data) {
+    switch (m_frameState) {
+        case Frame::Header:
+            m_frameType = data >> 4;
+            m_frameFlags = data & 0x0F;
+            m_frameLength = 0;
+            m_frameLengthBytes = 0;
+            m_frameMultiplier = 1;
+            m_frameState = Frame::Length;
+            break;
+
+        case Frame::Length:
+            m_frameLength += (data & 0x7F) * m_frameMultiplier;
+            m_frameLengthBytes++;
+            m_frameMultiplier <<= 7;
+            if ((data & 0x80) == 0) {
+                m_framePos = 0;
+                m_frameState = m_frameLength > 0 ? Frame::Body : Frame::Header;
+                m_streaming = m_frameType == MQTT_PACKET_PUBLISH && m_streamThreshold > 0 && m_streamBegin &&
+                              1 + m_frameLengthBytes + m_frameLength > m_streamThreshold;
+                if (m_streaming) {
+                    m_streamAccepted = false;
+                    m_streamPacketId = 0;
+                    m_streamPayloadStart = 0;
+                    m_streamTopicLength = 0;
+                    m_streamWindowLength = 0;
+                }
+            }
+            break;
+
+        case Frame::Body:
+            if (m_frameType == MQTT_PACKET_CONNACK && m_framePos == 0)
+                m_sessionPresent = data & 0x01;
+            if (m_streaming)
+                observePublish(data);
+            if (++m_framePos >= m_frameLength) {
+                if (m_streaming)
+                    endStream(true);
+                m_frameState = Frame::Header;
+            }
+            break;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMqttClient::observePublish(uint8_t data) {
+    // variable header: topic length (2 bytes), topic, packet id (2 bytes, only for QoS > 0)
+    uint32_t pos = m_framePos;
+    if (pos == 0) {
+        m_streamTopicLength = data << 8;
+    } else if (pos == 1) {
+        m_streamTopicLength |= data;
+        m_streamPayloadStart = 2 + m_streamTopicLength + ((m_frameFlags & 0x06) ? 2 : 0);
+    } else if (pos < 2u + m_streamTopicLength) {
+        if (pos - 2 < HSD_MQTT_STREAM_TOPIC_SIZE - 1)
+            m_streamTopic[pos - 2] = data;
+    } else if (pos < m_streamPayloadStart) {
+        m_streamPacketId = (m_streamPacketId << 8) | data;
+    } else if (m_streamAccepted) {
+        m_streamWindow[m_streamWindowLength++] = data;
+        if (m_streamWindowLength == HSD_MQTT_STREAM_WINDOW) {
+            if (m_streamData)
+                m_streamData(m_streamWindow, m_streamWindowLength);
+            m_streamWindowLength = 0;
+        }
+    }
+
+    if (pos >= 1 && pos + 1 == m_streamPayloadStart) { // variable header complete, payload follows
+        m_streamTopic[isStreamTopicTruncated() ? HSD_MQTT_STREAM_TOPIC_SIZE - 1 : m_streamTopicLength] = 0;
+        m_streamAccepted = m_streamBegin(m_streamTopic, m_frameLength - m_streamPayloadStart);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMqttClient::resetFrame() {
+    if (m_streaming)
+        endStream(false);
+    m_frameFlags = 0;
+    m_frameLength = 0;
+    m_frameLengthBytes = 0;
+    m_frameMultiplier = 1;
+    m_framePos = 0;
+    m_frameState = Frame::Header;
+    m_frameType = 0;
+}
@@ -0,0 +1,85 @@
+#ifndef HSDMQTTCLIENT_H
+#define HSDMQTTCLIENT_H
+
+#include <Client.h>
+#include <functional>
+#ifdef ESP32
+#include <WiFi.h>
+#elif defined(ESP8266)
+#include <ESP8266WiFi.h>
+#endif
+
+#define HSD_MQTT_STREAM_TOPIC_SIZE 128
+#define HSD_MQTT_STREAM_WINDOW     64
+
+/*
+ * Network client used by PubSubClient. It forwards everything to a WiFiClient, but follows the MQTT packet framing
+ * of the received data to learn things PubSubClient does not expose (e.g. the session present flag of CONNACK).
+ * PUBLISH packets too large for the PubSubClient buffer (which drops them) are passed to the stream handler instead,
+ * the payload in blocks of HSD_MQTT_STREAM_WINDOW bytes while it is received. A topic too long for the topic buffer
+ * is passed truncated, see isStreamTopicTruncated().
+ */
+class HSDMqttClient : public Client {
+public:
+    typedef std::function<bool(const char* topic, uint32_t length)> StreamBegin; // return false to skip the message
+    typedef std::function<void(const uint8_t* data, size_t length)> StreamData;
+    typedef std::function<void(bool complete)>                      StreamEnd;
+
+    HSDMqttClient();
+
+    int         available();
+    int         connect(IPAddress ip, uint16_t port);
+    int         connect(const char* host, uint16_t port);
+    int         connect(IPAddress ip, uint16_t port, int timeout);
+#ifdef ESP32
+    int         connect(const char* host, uint16_t port, int timeout);
+#endif
+    uint8_t     connected();
+    void        flush();
+    inline bool isStreamTopicTruncated() const { return m_streamTopicLength >= HSD_MQTT_STREAM_TOPIC_SIZE; }
+    operator    bool();
+    int         peek();
+    int         read();
+    int         read(uint8_t* buf, size_t size);
+    inline bool sessionPresent() const { return m_sessionPresent; }
+    void        stop();
+    void        setStreamHandler(size_t threshold, StreamBegin begin, StreamData data, StreamEnd end);
+    size_t      write(uint8_t data);
+    size_t      write(const uint8_t* buf, size_t size);
+
+private:
+    enum class Frame : uint8_t {
+        Header = 0,
+        Length,
+        Body
+    };
+
+    void endStream(bool complete);
+    void observe(uint8_t data);
+    void observePublish(uint8_t data);
+    void resetFrame();
+
+    WiFiClient  m_client;
+    uint8_t     m_frameFlags;
+    uint8_t     m_frameLengthBytes;
+    uint32_t    m_frameLength;
+    uint32_t    m_frameMultiplier;
+    uint32_t    m_framePos;
+    Frame       m_frameState;
+    uint8_t     m_frameType;
+    bool        m_sessionPresent;
+    bool        m_streamAccepted;
+    StreamBegin m_streamBegin;
+    StreamData  m_streamData;
+    StreamEnd   m_streamEnd;
+    uint16_t    m_streamPacketId;
+    uint32_t    m_streamPayloadStart; // position of the payload in the packet body
+    bool        m_streaming;          // current packet is a PUBLISH passed to the stream handler
+    size_t      m_streamThreshold;    // packets larger than this (incl. fixed header) are streamed
+    char        m_streamTopic[HSD_MQTT_STREAM_TOPIC_SIZE];
+    uint16_t    m_streamTopicLength;
+    uint8_t     m_streamWindow[HSD_MQTT_STREAM_WINDOW];
+    size_t      m_streamWindowLength;
+};
+
+#endif // HSDMQTTCLIENT_H
@@ -0,0 +1,52 @@
+#include "HSDMqttQueue.hpp"
+
+HSDMqttQueue::HSDMqttQueue() :
+    m_coalesced(0),
+    m_count(0),
+    m_drops(0),
+    m_head(0),
+    m_maxDepth(0)
+{
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDMqttQueue::pop() {
+    if (m_count > 0) {
+        m_head = (m_head + 1) % HSD_MQTT_QUEUE_SIZE;
+        m_count--;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDMqttQueue::push(const char* topic, const char* payload, bool coalesce) {
+    if (strlen(topic) >= HSD_MQTT_QUEUE_TOPIC_SIZE || strlen(payload) >= HSD_MQTT_QUEUE_PAYLOAD_SIZE) {
+        m_drops++;
+        return false;
+    }
+
+    if (coalesce) {
+        for (uint8_t idx = 0; idx < m_count; idx++) {
+            Entry& entry = m_entries[(m_head + idx) % HSD_MQTT_QUEUE_SIZE];
+            if (entry.coalesce && strcmp(entry.topic, topic) == 0) {
+                strcpy(entry.payload, payload);
+                m_coalesced++;
+                return true;
+            }
+        }
+    }
+
+    if (m_count == HSD_MQTT_QUEUE_SIZE) { // full, drop the oldest
+        pop();
+        m_drops++;
+    }
+    Entry& entry = m_entries[(m_head + m_count) % HSD_MQTT_QUEUE_SIZE];
+    strcpy(entry.topic, topic);
+    strcpy(entry.payload, payload);
+    entry.coalesce = coalesce;
+    m_count++;
+    if (m_count > m_maxDepth)
+        m_maxDepth = m_count;
+    return true;
+}
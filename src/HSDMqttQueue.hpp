@@ -0,0 +1,44 @@
+#ifndef HSDMQTTQUEUE_H
+#define HSDMQTTQUEUE_H
+
+#include <Arduino.h>
+
+#define HSD_MQTT_QUEUE_SIZE         8
+#define HSD_MQTT_QUEUE_TOPIC_SIZE   64
+#define HSD_MQTT_QUEUE_PAYLOAD_SIZE 192
+
+/*
+ * Bounded queue for outgoing MQTT messages, kept while the broker is not reachable. All entries are preallocated.
+ * Coalescing entries (periodic values like sensor readings) are replaced in place by newer messages for the same
+ * topic, all other entries keep their order. If the queue is full, the oldest entry is dropped.
+ */
+class HSDMqttQueue {
+public:
+    HSDMqttQueue();
+
+    inline unsigned int getCoalesced() const { return m_coalesced; }
+    inline unsigned int getDepth() const { return m_count; }
+    inline unsigned int getDrops() const { return m_drops; }
+    inline unsigned int getMaxDepth() const { return m_maxDepth; }
+    inline const char*  frontPayload() const { return m_entries[m_head].payload; }
+    inline const char*  frontTopic() const { return m_entries[m_head].topic; }
+    inline bool         isEmpty() const { return m_count == 0; }
+    void                pop();
+    bool                push(const char* topic, const char* payload, bool coalesce);
+
+private:
+    struct Entry {
+        char topic[HSD_MQTT_QUEUE_TOPIC_SIZE];
+        char payload[HSD_MQTT_QUEUE_PAYLOAD_SIZE];
+        bool coalesce;
+    };
+
+    unsigned int m_coalesced; // messages replaced by a newer one for the same topic
+    uint8_t      m_count;
+    unsigned int m_drops;     // messages lost because the queue was full or the message too large
+    Entry        m_entries[HSD_MQTT_QUEUE_SIZE];
+    uint8_t      m_head;
+    unsigned int m_maxDepth;
+};
+
+#endif // HSDMQTTQUEUE_H
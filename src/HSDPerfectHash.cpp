@@ -0,0 +1,119 @@
+#include "HSDPerfectHash.hpp"
+
+#include <algorithm>
+
+#define MAX_BUILD_ATTEMPTS 3
+#define MAX_SEED           0xFFFF
+
+HSDPerfectHash::HSDPerfectHash() {
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDPerfectHash::build(const vector<const String*>& keys) {
+    clear();
+    if (keys.size() > 0x7FFF)
+        return false;
+
+    // duplicate keys are skipped, so the first occurrence wins - same result as a linear search
+    vector<uint32_t> hashes(keys.size());
+    vector<int16_t> unique;
+    for (size_t idx = 0; idx < keys.size(); idx++) {
+        hashes[idx] = hash(keys[idx]->c_str(), keys[idx]->length());
+        bool duplicate(false);
+        for (size_t prev = 0; prev < unique.size() && !duplicate; prev++) {
+            if (hashes[unique[prev]] != hashes[idx])
+                continue;
+            if (!keys[unique[prev]]->equals(*keys[idx]))
+                return false; // different keys with the same hash never get different slots, no seed search
+            duplicate = true;
+        }
+        if (!duplicate)
+            unique.push_back(idx);
+    }
+    if (unique.empty())
+        return true;
+
+    size_t numBuckets = unique.size() / 2 + 1;
+    size_t numSlots = unique.size() + unique.size() / 4 + 1;
+    vector<vector<int16_t>> buckets(numBuckets);
+    for (auto idx : unique)
+        buckets[hashes[idx] % numBuckets].push_back(idx);
+
+    // place the largest buckets first, while the table is still empty
+    vector<uint16_t> order(numBuckets);
+    for (size_t idx = 0; idx < numBuckets; idx++)
+        order[idx] = idx;
+    sort(order.begin(), order.end(), [&](uint16_t a, uint16_t b) { return buckets[a].size() > buckets[b].size(); });
+
+    vector<size_t> placed;
+    for (int attempt = 0; attempt < MAX_BUILD_ATTEMPTS; attempt++, numSlots *= 2) {
+        m_seeds.assign(numBuckets, 0);
+        m_slots.assign(numSlots, -1);
+        bool success(true);
+        for (size_t idx = 0; idx < numBuckets && success; idx++) {
+            const vector<int16_t>& bucket = buckets[order[idx]];
+            if (bucket.empty())
+                break;
+            success = false;
+            for (uint32_t seed = 0; seed <= MAX_SEED && !success; seed++) {
+                placed.clear();
+                bool fits(true);
+                for (size_t key = 0; key < bucket.size() && fits; key++) {
+                    size_t slot = mix(hashes[bucket[key]], seed) % numSlots;
+                    fits = m_slots[slot] == -1 && std::find(placed.begin(), placed.end(), slot) == placed.end();
+                    placed.push_back(slot);
+                }
+                if (fits) {
+                    for (size_t key = 0; key < bucket.size(); key++)
+                        m_slots[placed[key]] = bucket[key];
+                    m_seeds[order[idx]] = seed;
+                    success = true;
+                }
+            }
+        }
+        if (success)
+            return true;
+    }
+    clear();
+    return false;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDPerfectHash::clear() {
+    m_seeds.clear();
+    m_slots.clear();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+int HSDPerfectHash::find(const char* key, size_t length) const {
+    if (m_slots.empty())
+        return -1;
+    uint32_t keyHash = hash(key, length);
+    return m_slots[mix(keyHash, m_seeds[keyHash % m_seeds.size()]) % m_slots.size()];
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+uint32_t HSDPerfectHash::hash(const char* key, size_t length) {
+    uint32_t res = 2166136261u; // FNV-1a
+    for (size_t idx = 0; idx < length; idx++) {
+        res ^= static_cast<uint8_t>(key[idx]);
+        res *= 16777619u;
+    }
+    return res;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+uint32_t HSDPerfectHash::mix(uint32_t hash, uint16_t seed) {
+    uint32_t res = hash ^ (seed * 0x9E3779B9u);
+    res ^= res >> 16;
+    res *= 0x85EBCA6Bu;
+    res ^= res >> 13;
+    res *= 0xC2B2AE35u;
+    res ^= res >> 16;
+    return res;
+}
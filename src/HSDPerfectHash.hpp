@@ -0,0 +1,31 @@
+#ifndef HSDPERFECTHASH_H
+#define HSDPERFECTHASH_H
+
+#include <Arduino.h>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Minimal perfect hash (hash and displace) over a set of strings. A lookup costs one hash of the key plus one
+ * table access, the caller has to do the final compare against the key stored at the returned index.
+ */
+class HSDPerfectHash {
+public:
+    HSDPerfectHash();
+
+    bool            build(const vector<const String*>& keys);
+    void            clear();
+    int             find(const char* key, size_t length) const;
+    inline int      find(const String& key) const { return find(key.c_str(), key.length()); }
+    static uint32_t hash(const char* key, size_t length);
+    inline bool     isEmpty() const { return m_slots.empty(); }
+
+private:
+    static uint32_t mix(uint32_t hash, uint16_t seed);
+
+    vector<uint16_t> m_seeds; // displacement seed per bucket
+    vector<int16_t>  m_slots; // key index per slot, -1 if unused
+};
+
+#endif // HSDPERFECTHASH_H
@@ -0,0 +1,419 @@
+#include "HSDRules.hpp"
+#include "HSDLogger.hpp"
+
+// instructions, operands are input and constant indices of one byte each
+#define OP_TRUTHY 0x01 // <input>
+#define OP_EQ     0x02 // <input> <constant>
+#define OP_NE     0x03
+#define OP_LT     0x04
+#define OP_LE     0x05
+#define OP_GT     0x06
+#define OP_GE     0x07
+#define OP_NOT    0x10
+#define OP_AND    0x11
+#define OP_OR     0x12
+
+#define MAX_STACK_DEPTH 32 // the stack is a bit field
+
+HSDRules::HSDRules() :
+    m_dirty(0),
+    m_errors(0),
+    m_evaluations(0),
+    m_evaluationMicros(0)
+{
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+size_t HSDRules::compile(const String& source) {
+    vector<Input> previous; // the statuses received so far, no new message may come for a while
+    previous.swap(m_inputs);
+    m_code.clear();
+    m_constants.clear();
+    m_dirty = 0;
+    m_errors = 0;
+    m_inputIndex.clear();
+    m_rules.clear();
+    m_source = source;
+
+    const char* pos = source.c_str();
+    const char* end = pos + source.length();
+    while (pos < end) {
+        const char* ruleEnd = pos;
+        while (ruleEnd < end && *ruleEnd != ';' && *ruleEnd != '\n' && *ruleEnd != '\r')
+            ruleEnd++;
+        skipSpace(pos, ruleEnd);
+        if (pos < ruleEnd) {
+            const char* ruleStart = pos;
+            size_t codeSize = m_code.size();
+            if (m_rules.size() >= HSD_RULES_MAX) {
+                Logger.log("Too many rules, ignoring '%s'", toString(ruleStart, ruleEnd).c_str());
+                m_errors++;
+            } else if (!compileRule(pos, ruleEnd)) {
+                Logger.log("Error in rule '%s' at position %u", toString(ruleStart, ruleEnd).c_str(),
+                           static_cast<unsigned int>(pos - ruleStart + 1));
+                m_code.resize(codeSize);
+                m_errors++;
+            }
+        }
+        pos = ruleEnd + 1;
+    }
+
+    vector<const String*> keys;
+    for (Input& input : m_inputs) {
+        keys.push_back(&input.name);
+        for (const Input& old : previous) {
+            if (old.name == input.name) {
+                memcpy(input.value, old.value, HSD_RULES_VALUE_SIZE);
+                input.number = old.number;
+                input.numeric = old.numeric;
+                break;
+            }
+        }
+    }
+    m_inputIndex.build(keys);
+    m_dirty = m_rules.size() == HSD_RULES_MAX ? 0xFFFFFFFF : (1u << m_rules.size()) - 1;
+    Logger.log("Compiled %u rules (%u bytes of code, %u inputs), %u errors", m_rules.size(), m_code.size(),
+               m_inputs.size(), m_errors);
+    return m_errors;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDRules::evaluate(ResultCallback callback) {
+    if (m_dirty == 0)
+        return;
+
+    unsigned long start = micros();
+    uint32_t dirty = m_dirty;
+    m_dirty = 0;
+    for (size_t idx = 0; idx < m_rules.size() && dirty != 0; idx++, dirty >>= 1) {
+        if ((dirty & 1) == 0)
+            continue;
+        Rule& rule = m_rules[idx];
+        int8_t result = execute(rule) ? 1 : 0;
+        m_evaluations++;
+        if (result != rule.result) {
+            rule.result = result;
+            callback(rule.led, result ? rule.onTrue : rule.onFalse);
+        }
+    }
+    m_evaluationMicros += micros() - start;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDRules::invalidate() {
+    // e.g. after the LEDs were cleared, the results are passed to the callback again even if unchanged
+    for (Rule& rule : m_rules)
+        rule.result = -1;
+    m_dirty = m_rules.size() == HSD_RULES_MAX ? 0xFFFFFFFF : (1u << m_rules.size()) - 1;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDRules::update(const String& device, const String& status) {
+    int index;
+    if (m_inputIndex.isEmpty()) { // index could not be built, fall back to linear search
+        for (index = m_inputs.size() - 1; index >= 0 && m_inputs[index].name != device; index--);
+    } else {
+        index = m_inputIndex.find(device);
+    }
+    if (index == -1 || m_inputs[index].name != device)
+        return;
+
+    Input& input = m_inputs[index];
+    if (strncmp(input.value, status.c_str(), HSD_RULES_VALUE_SIZE - 1) == 0 &&
+        (status.length() >= HSD_RULES_VALUE_SIZE - 1 || input.value[status.length()] == 0))
+        return;
+    setValue(input, status);
+    m_dirty |= input.rules;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDRules::compileRule(const char*& pos, const char* end) {
+    // <led> = <condition> ? <message> [: <message>]
+    Rule rule;
+    String token;
+    if (!readToken(pos, end, token) || token.toInt() < 0 || token.toInt() > 255 ||
+        (token != "0" && token.toInt() == 0))
+        return false;
+    rule.led = token.toInt();
+    skipSpace(pos, end);
+    if (pos >= end || *pos != '=' || (pos + 1 < end && pos[1] == '='))
+        return false;
+    pos++;
+
+    rule.codeStart = m_code.size();
+    uint8_t depth = 0;
+    if (!parseOr(pos, end, depth))
+        return false;
+    rule.codeEnd = m_code.size();
+
+    skipSpace(pos, end);
+    if (pos >= end || *pos != '?')
+        return false;
+    pos++;
+    if (!readToken(pos, end, rule.onTrue))
+        return false;
+    skipSpace(pos, end);
+    if (pos < end && *pos == ':') {
+        pos++;
+        if (!readToken(pos, end, rule.onFalse))
+            return false;
+        skipSpace(pos, end);
+    }
+    if (pos < end)
+        return false;
+    rule.result = -1;
+
+    // every input read by the rule has to mark it for evaluation
+    uint32_t mask = 1u << m_rules.size();
+    for (size_t pc = rule.codeStart; pc < rule.codeEnd; pc++) {
+        uint8_t op = m_code[pc];
+        if (op >= OP_TRUTHY && op <= OP_GE) {
+            m_inputs[m_code[pc + 1]].rules |= mask;
+            pc += op == OP_TRUTHY ? 1 : 2;
+        }
+    }
+    m_rules.push_back(rule);
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDRules::compare(uint8_t op, const Input& input, const Constant& constant) const {
+    bool numeric = input.numeric && constant.numeric;
+    if (op == OP_EQ || op == OP_NE) {
+        bool equal = numeric ? input.number == constant.number : constant.text.equals(input.value);
+        return op == OP_EQ ? equal : !equal;
+    }
+    if (!numeric) // ordering is only defined for numbers
+        return false;
+    switch (op) {
+        case OP_LT: return input.number < constant.number;
+        case OP_LE: return input.number <= constant.number;
+        case OP_GT: return input.number > constant.number;
+        case OP_GE: return input.number >= constant.number;
+    }
+    return false;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+int HSDRules::constantIndex(const String& text) {
+    for (size_t idx = 0; idx < m_constants.size(); idx++)
+        if (m_constants[idx].text == text)
+            return idx;
+    if (m_constants.size() > 255)
+        return -1;
+
+    Constant constant;
+    constant.text = text;
+    char* numberEnd;
+    constant.number = strtod(text.c_str(), &numberEnd);
+    constant.numeric = text.length() > 0 && *numberEnd == 0;
+    m_constants.push_back(constant);
+    return m_constants.size() - 1;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDRules::execute(const Rule& rule) const {
+    uint32_t stack = 0; // top of stack is bit 0
+    for (size_t pc = rule.codeStart; pc < rule.codeEnd; pc++) {
+        uint8_t op = m_code[pc];
+        switch (op) {
+            case OP_TRUTHY:
+                stack = (stack << 1) | (truthy(m_inputs[m_code[++pc]]) ? 1 : 0);
+                break;
+            case OP_NOT:
+                stack ^= 1;
+                break;
+            case OP_AND:
+                stack = (stack >> 1) & ((stack & 1) ? 0xFFFFFFFF : 0xFFFFFFFE);
+                break;
+            case OP_OR:
+                stack = (stack >> 1) | (stack & 1);
+                break;
+            default: // comparison
+                stack = (stack << 1) | (compare(op, m_inputs[m_code[pc + 1]], m_constants[m_code[pc + 2]]) ? 1 : 0);
+                pc += 2;
+                break;
+        }
+    }
+    return stack & 1;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+int HSDRules::inputIndex(const String& name) {
+    for (size_t idx = 0; idx < m_inputs.size(); idx++)
+        if (m_inputs[idx].name == name)
+            return idx;
+    if (m_inputs.size() > 255)
+        return -1;
+
+    Input input;
+    input.name = name;
+    input.rules = 0;
+    setValue(input, "");
+    m_inputs.push_back(input);
+    return m_inputs.size() - 1;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDRules::parseAnd(const char*& pos, const char* end, uint8_t& depth) {
+    if (!parseUnary(pos, end, depth))
+        return false;
+    skipSpace(pos, end);
+    while (pos + 1 < end && pos[0] == '&' && pos[1] == '&') {
+        pos += 2;
+        if (!parseUnary(pos, end, depth))
+            return false;
+        m_code.push_back(OP_AND);
+        depth--;
+        skipSpace(pos, end);
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDRules::parseCondition(const char*& pos, const char* end, uint8_t& depth) {
+    // <device> [<operator> <value>], a device without comparison is true unless its status is empty, 0, off or false
+    String device;
+    if (!readToken(pos, end, device))
+        return false;
+    int input = inputIndex(device);
+    if (input == -1 || ++depth > MAX_STACK_DEPTH)
+        return false;
+
+    skipSpace(pos, end);
+    uint8_t op = OP_TRUTHY;
+    if (pos + 1 < end && pos[1] == '=') {
+        switch (pos[0]) {
+            case '=': op = OP_EQ; break;
+            case '!': op = OP_NE; break;
+            case '<': op = OP_LE; break;
+            case '>': op = OP_GE; break;
+        }
+        if (op != OP_TRUTHY)
+            pos += 2;
+    } else if (pos < end && (*pos == '<' || *pos == '>')) {
+        op = *pos == '<' ? OP_LT : OP_GT;
+        pos++;
+    }
+
+    m_code.push_back(op);
+    m_code.push_back(input);
+    if (op != OP_TRUTHY) {
+        String value;
+        if (!readToken(pos, end, value))
+            return false;
+        int constant = constantIndex(value);
+        if (constant == -1)
+            return false;
+        m_code.push_back(constant);
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDRules::parseOr(const char*& pos, const char* end, uint8_t& depth) {
+    if (!parseAnd(pos, end, depth))
+        return false;
+    skipSpace(pos, end);
+    while (pos + 1 < end && pos[0] == '|' && pos[1] == '|') {
+        pos += 2;
+        if (!parseAnd(pos, end, depth))
+            return false;
+        m_code.push_back(OP_OR);
+        depth--;
+        skipSpace(pos, end);
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDRules::parseUnary(const char*& pos, const char* end, uint8_t& depth) {
+    skipSpace(pos, end);
+    if (pos < end && *pos == '!') {
+        pos++;
+        if (!parseUnary(pos, end, depth))
+            return false;
+        m_code.push_back(OP_NOT);
+        return true;
+    }
+    if (pos < end && *pos == '(') {
+        pos++;
+        if (!parseOr(pos, end, depth))
+            return false;
+        skipSpace(pos, end);
+        if (pos >= end || *pos != ')')
+            return false;
+        pos++;
+        return true;
+    }
+    return parseCondition(pos, end, depth);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDRules::readToken(const char*& pos, const char* end, String& token) {
+    // quoted string or a word up to the next space or operator
+    skipSpace(pos, end);
+    const char* start = pos;
+    if (pos < end && *pos == '"') {
+        start = ++pos;
+        while (pos < end && *pos != '"')
+            pos++;
+        if (pos >= end)
+            return false;
+        token = toString(start, pos);
+        pos++;
+        return true;
+    }
+    while (pos < end && !isspace(*pos) && strchr("()!=<>&|?:\"", *pos) == nullptr)
+        pos++;
+    token = toString(start, pos);
+    return pos > start;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDRules::setValue(Input& input, const String& status) {
+    strncpy(input.value, status.c_str(), HSD_RULES_VALUE_SIZE - 1);
+    input.value[HSD_RULES_VALUE_SIZE - 1] = 0;
+    char* numberEnd;
+    input.number = strtod(input.value, &numberEnd);
+    input.numeric = input.value[0] != 0 && *numberEnd == 0;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDRules::skipSpace(const char*& pos, const char* end) const {
+    while (pos < end && isspace(*pos))
+        pos++;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+String HSDRules::toString(const char* start, const char* end) {
+    String text;
+    text.reserve(end - start);
+    while (start < end)
+        text += *start++;
+    return text;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDRules::truthy(const Input& input) const {
+    return input.value[0] != 0 && strcmp(input.value, "0") != 0 && strcasecmp(input.value, "off") != 0 &&
+           strcasecmp(input.value, "false") != 0;
+}
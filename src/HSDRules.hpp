@@ -0,0 +1,89 @@
+#ifndef HSDRULES_H
+#define HSDRULES_H
+
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+
+#include "HSDPerfectHash.hpp"
+
+using namespace std;
+
+#define HSD_RULES_MAX        32 // one bit per rule in the dependency masks
+#define HSD_RULES_VALUE_SIZE 24 // stored length of an input status
+
+/*
+ * Rules computing the status of an LED from the statuses of several devices, e.g.
+ *   12 = (window1 == open || window2 == open) && alarm == armed ? alarm : ok
+ * Rules are separated by ';' or line breaks. They are compiled to a small stack machine code. Every input device
+ * keeps a mask of the rules reading it, so a status update only marks these rules for evaluation.
+ */
+class HSDRules {
+public:
+    typedef std::function<void(uint8_t led, const String& message)> ResultCallback;
+
+    HSDRules();
+
+    size_t               compile(const String& source);
+    void                 evaluate(ResultCallback callback);
+    inline size_t        getErrors() const { return m_errors; }
+    inline uint32_t      getEvaluations() const { return m_evaluations; }
+    inline uint32_t      getEvaluationMicros() const { return m_evaluationMicros; }
+    inline size_t        getRuleCount() const { return m_rules.size(); }
+    inline const String& getSource() const { return m_source; }
+    void                 invalidate();
+    inline bool          isDirty() const { return m_dirty != 0; }
+    void                 update(const String& device, const String& status);
+
+private:
+    struct Input {
+        String   name;
+        uint32_t rules;  // mask of the rules reading this input
+        double   number;
+        bool     numeric;
+        char     value[HSD_RULES_VALUE_SIZE];
+    };
+
+    struct Constant {
+        String text;
+        double number;
+        bool   numeric;
+    };
+
+    struct Rule {
+        uint16_t codeStart;
+        uint16_t codeEnd;
+        uint8_t  led;
+        int8_t   result;  // -1 if not evaluated yet
+        String   onFalse;
+        String   onTrue;
+    };
+
+    bool     compileRule(const char*& pos, const char* end);
+    bool     compare(uint8_t op, const Input& input, const Constant& constant) const;
+    int      constantIndex(const String& text);
+    bool     execute(const Rule& rule) const;
+    int      inputIndex(const String& name);
+    bool     parseAnd(const char*& pos, const char* end, uint8_t& depth);
+    bool     parseCondition(const char*& pos, const char* end, uint8_t& depth);
+    bool     parseOr(const char*& pos, const char* end, uint8_t& depth);
+    bool     parseUnary(const char*& pos, const char* end, uint8_t& depth);
+    bool     readToken(const char*& pos, const char* end, String& token);
+    void     setValue(Input& input, const String& status);
+    void     skipSpace(const char*& pos, const char* end) const;
+    static String toString(const char* start, const char* end);
+    bool     truthy(const Input& input) const;
+
+    vector<uint8_t>  m_code;
+    vector<Constant> m_constants;
+    uint32_t         m_dirty;            // mask of the rules to evaluate
+    size_t           m_errors;
+    uint32_t         m_evaluations;
+    uint32_t         m_evaluationMicros; // sum over all evaluations
+    HSDPerfectHash   m_inputIndex;
+    vector<Input>    m_inputs;
+    vector<Rule>     m_rules;
+    String           m_source;
+};
+
+#endif // HSDRULES_H
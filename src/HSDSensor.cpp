@@ -38,6 +38,8 @@ Contact D | G   3,3V
 HSDSensor::HSDSensor(const HSDConfig* config) :
     m_bmp(nullptr),
     m_config(config),
+    m_humidity(NAN),
+    m_lux(NAN),
     m_maxCycles(microsecondsToClockCycles(1000)), // 1 millisecond timeout for reading pulses from DHT sensor.
     m_pin(0),
     m_pirInterruptCounter(0),
@@ -46,6 +48,8 @@ HSDSensor::HSDSensor(const HSDConfig* config) :
 #endif    
     m_pirPin(0),
     m_pirValue(LOW),
+    m_pressure(NAN),
+    m_temperature(NAN),
     m_tsl(nullptr)
 {
 }
@@ -147,6 +151,8 @@ void HSDSensor::handle(HSDWebserver* webServer, const HSDMqtt* mqtt) {
                 Logger.print(hum, 1);
                 Logger.println("%");
                 
+                m_temperature = temp;
+                m_humidity = hum;
                 webServer->updateStatusEntry("temperature", String(temp, 1));
                 webServer->updateStatusEntry("humidity", String(hum, 1));
                 
@@ -166,6 +172,7 @@ void HSDSensor::handle(HSDWebserver* webServer, const HSDMqtt* mqtt) {
                 Logger.print(press, 1);
                 Logger.println(" hPa");
                 
+                m_pressure = press;
                 webServer->updateStatusEntry("pressure", String(press, 1));
                 
                 json["Pressure"] = press;
@@ -180,6 +187,7 @@ void HSDSensor::handle(HSDWebserver* webServer, const HSDMqtt* mqtt) {
                 /* Display the results (light is measured in lux) */
                 Logger.print("TSL2561: "); Logger.print(event.light, 0); Logger.println(" lux");
                 
+                m_lux = event.light;
                 webServer->updateStatusEntry("lux", String(event.light, 0));
                 
                 json["Lux"] = event.light;
@@ -188,11 +196,9 @@ void HSDSensor::handle(HSDWebserver* webServer, const HSDMqtt* mqtt) {
             }            
         }
           
-        if (mqtt->connected()) {
-            String topic = m_config->getMqttOutTopic("sensor");
-            if (mqtt->isTopicValid(topic))
-                mqtt->publish(topic, json);
-        }
+        String topic = m_config->getMqttOutTopic("sensor");
+        if (mqtt->isTopicValid(topic))
+            mqtt->publish(topic, json, true);
     }
 }
 
@@ -330,3 +336,17 @@ void HSDSensor::printSensorDetails(sensor_t& sensor) const {
     Logger.print(sensor.resolution);
     Logger.println(")");
 }
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDSensor::writeMetrics(HSDMetricsWriter& metrics) const {
+    // sensors without a reading are left out
+    if (!isnan(m_temperature))
+        metrics.addGauge("hsd_sensor_temperature_celsius", "Temperature (Sonoff SI7021)", m_temperature);
+    if (!isnan(m_humidity))
+        metrics.addGauge("hsd_sensor_humidity_percent", "Relative humidity (Sonoff SI7021)", m_humidity);
+    if (!isnan(m_pressure))
+        metrics.addGauge("hsd_sensor_pressure_hpa", "Air pressure at sea level (BMP180)", m_pressure);
+    if (!isnan(m_lux))
+        metrics.addGauge("hsd_sensor_light_lux", "Illuminance (TSL2561)", m_lux);
+}
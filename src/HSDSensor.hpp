@@ -5,6 +5,7 @@
 #include <Adafruit_TSL2561_U.h>
 
 #include "HSDConfig.hpp"
+#include "HSDMetricsWriter.hpp"
 #include "HSDMqtt.hpp"
 #include "HSDWebserver.hpp"
 
@@ -14,6 +15,7 @@ public:
     
     void begin(HSDWebserver* webServer);
     void handle(HSDWebserver* webServer, const HSDMqtt* mqtt);
+    void writeMetrics(HSDMetricsWriter& metrics) const;
 
 private:
     int32_t expectPulse(bool level) const;
@@ -24,6 +26,8 @@ private:
 
     Adafruit_BMP085_Unified*  m_bmp;
     const HSDConfig*          m_config;
+    float                     m_humidity;    // last readings, NAN if not read yet
+    float                     m_lux;
     uint32_t                  m_maxCycles;
     uint8_t                   m_pin;
     volatile int              m_pirInterruptCounter;
@@ -32,6 +36,8 @@ private:
 #endif    
     uint8_t                   m_pirPin;
     volatile uint8_t          m_pirValue;
+    float                     m_pressure;
+    float                     m_temperature;
     Adafruit_TSL2561_Unified* m_tsl;
 
 friend void IRAM_ATTR detectsMotion(void* arg);
@@ -0,0 +1,223 @@
+#include "HSDTopicTrie.hpp"
+#include "HSDPerfectHash.hpp"
+
+#include <algorithm>
+
+HSDTopicTrie::HSDTopicTrie() {
+    clear();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDTopicTrie::build(const String& filters) {
+    clear();
+    m_source = filters;
+    bool success(true);
+    int start(-1);
+    for (unsigned int pos = 0; pos <= filters.length(); pos++) {
+        char ch = pos < filters.length() ? filters[pos] : 0;
+        bool separator = ch == 0 || ch == ',' || ch == ';' || ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+        if (!separator && start < 0) {
+            start = pos;
+        } else if (separator && start >= 0) {
+            if (!addFilter(filters.substring(start, pos)))
+                success = false;
+            start = -1;
+        }
+    }
+    sortNodes();
+    return success;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDTopicTrie::clear() {
+    m_filters.clear();
+    m_nodes.clear();
+    m_nodes.push_back(Node { 0, 0, -1, -1, -1, 0, -1, 0, -1, -1 });
+    m_source = "";
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+int HSDTopicTrie::match(const char* topic, String& device) const {
+    uint8_t starts[HSD_TOPIC_MAX_LEVELS], lengths[HSD_TOPIC_MAX_LEVELS];
+    uint8_t levels(0);
+    size_t start(0), pos(0);
+    for (;; pos++) {
+        if (topic[pos] == '/' || topic[pos] == 0) {
+            if (levels == HSD_TOPIC_MAX_LEVELS || pos > 0xFF)
+                return -1;
+            starts[levels] = start;
+            lengths[levels++] = pos - start;
+            start = pos + 1;
+            if (topic[pos] == 0)
+                break;
+        }
+    }
+
+    int best(-1);
+    matchNode(0, topic, starts, lengths, 0, levels, best);
+    if (best >= 0) {
+        int8_t level = m_filters[best].deviceLevel;
+        if (level < 0 || level >= levels)
+            level = levels - 1;
+        device = "";
+        device.concat(topic + starts[level], lengths[level]);
+    }
+    return best;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDTopicTrie::addFilter(const String& filter) {
+    if (m_filters.size() >= 0x7FFF)
+        return false;
+    
+    Filter entry { filter, -1 };
+    // '@' only starts the level suffix in the last level and followed by digits, otherwise it is part of the topic
+    int at = filter.lastIndexOf('@');
+    bool suffix = at > filter.lastIndexOf('/') && at + 1 < static_cast<int>(filter.length());
+    for (unsigned int pos = at + 1; suffix && pos < filter.length(); pos++)
+        suffix = isdigit(filter[pos]);
+    if (!suffix)
+        at = -1;
+    if (at >= 0) {
+        int level = filter.substring(at + 1).toInt();
+        if (level < 1 || level > HSD_TOPIC_MAX_LEVELS)
+            return false;
+        entry.topic = filter.substring(0, at);
+        entry.deviceLevel = level - 1;
+    }
+    if (entry.topic.length() == 0 || entry.topic.length() > 0xFF)
+        return false;
+    
+    // validate before the filter is added: wildcards must fill a whole level, '#' must be the last level
+    const String& topic = entry.topic;
+    uint8_t level(0);
+    for (unsigned int pos = 0; pos < topic.length(); pos++) {
+        char ch = topic[pos];
+        bool levelStart = pos == 0 || topic[pos - 1] == '/';
+        bool levelEnd = pos + 1 == topic.length() || topic[pos + 1] == '/';
+        if ((ch == '+' || ch == '#') && (!levelStart || !levelEnd))
+            return false;
+        if (ch == '#' && pos + 1 != topic.length())
+            return false;
+        if (ch == '+' && entry.deviceLevel < 0 && at < 0)
+            entry.deviceLevel = level;
+        if (ch == '/' && ++level >= HSD_TOPIC_MAX_LEVELS)
+            return false;
+    }
+    if (entry.deviceLevel > level && topic[topic.length() - 1] != '#') // the topic can never have that level
+        return false;
+
+    int16_t idx = m_filters.size();
+    m_filters.push_back(entry);
+    int node(0);
+    unsigned int start(0);
+    for (unsigned int pos = 0; pos <= topic.length(); pos++) {
+        if (pos < topic.length() && topic[pos] != '/')
+            continue;
+        uint8_t length = pos - start;
+        if (length == 1 && topic[start] == '#') {
+            if (m_nodes[node].hashFilter < 0)
+                m_nodes[node].hashFilter = idx;
+            return true;
+        }
+        node = addNode(node, idx, start, length);
+        start = pos + 1;
+    }
+    if (m_nodes[node].filter < 0)
+        m_nodes[node].filter = idx;
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+int HSDTopicTrie::addNode(int parent, int16_t filter, uint8_t offset, uint8_t length) {
+    const char* name = m_filters[filter].topic.c_str() + offset;
+    if (length == 1 && name[0] == '+') {
+        if (m_nodes[parent].plusChild < 0) {
+            m_nodes.push_back(Node { 0, 0, -1, -1, -1, 0, -1, 0, -1, -1 });
+            m_nodes[parent].plusChild = m_nodes.size() - 1;
+        }
+        return m_nodes[parent].plusChild;
+    }
+    
+    uint32_t hash = HSDPerfectHash::hash(name, length);
+    for (int child = m_nodes[parent].firstChild; child >= 0; child = m_nodes[child].nextSibling) {
+        const Node& node = m_nodes[child];
+        if (node.hash == hash && node.length == length && 
+            strncmp(m_filters[node.nameFilter].topic.c_str() + node.nameOffset, name, length) == 0)
+            return child;
+    }
+    m_nodes.push_back(Node { 0, hash, -1, -1, -1, length, filter, offset, m_nodes[parent].firstChild, -1 });
+    m_nodes[parent].firstChild = m_nodes.size() - 1;
+    m_nodes[parent].childCount++;
+    return m_nodes[parent].firstChild;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDTopicTrie::matchNode(int node, const char* topic, const uint8_t* starts, const uint8_t* lengths, 
+                             uint8_t level, uint8_t levels, int& best) const {
+    const Node& current = m_nodes[node];
+    bool wildcards = level > 0 || topic[0] != '$'; // system topics are not matched by leading wildcards
+    if (wildcards && current.hashFilter >= 0 && (best < 0 || current.hashFilter < best)) // '#' also matches the parent level
+        best = current.hashFilter;
+    if (level == levels) {
+        if (current.filter >= 0 && (best < 0 || current.filter < best))
+            best = current.filter;
+        return;
+    }
+
+    const char* name = topic + starts[level];
+    uint32_t hash = HSDPerfectHash::hash(name, lengths[level]);
+    int low(current.firstChild), high(current.firstChild + current.childCount);
+    while (low < high) { // first child with this hash
+        int middle = (low + high) / 2;
+        if (m_nodes[middle].hash < hash)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    for (int child = low; child < current.firstChild + current.childCount && m_nodes[child].hash == hash; child++) {
+        const Node& next = m_nodes[child];
+        if (next.length == lengths[level] && 
+            strncmp(m_filters[next.nameFilter].topic.c_str() + next.nameOffset, name, lengths[level]) == 0) {
+            matchNode(child, topic, starts, lengths, level + 1, levels, best);
+            break;
+        }
+    }
+    if (wildcards && current.plusChild >= 0)
+        matchNode(current.plusChild, topic, starts, lengths, level + 1, levels, best);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDTopicTrie::sortNodes() {
+    // store the named children of each node next to each other, ordered by hash, breadth first from the root
+    vector<int16_t> order(1, 0); // old index of each new node
+    vector<int16_t> index(m_nodes.size(), -1);
+    vector<Node> nodes;
+    nodes.reserve(m_nodes.size());
+    index[0] = 0;
+    for (size_t pos = 0; pos < order.size(); pos++) {
+        Node node = m_nodes[order[pos]];
+        size_t first = order.size();
+        for (int child = node.firstChild; child >= 0; child = m_nodes[child].nextSibling)
+            order.push_back(child);
+        sort(order.begin() + first, order.end(), [this](int16_t a, int16_t b) { 
+            return m_nodes[a].hash < m_nodes[b].hash; 
+        });
+        if (node.plusChild >= 0)
+            order.push_back(node.plusChild);
+        for (size_t idx = first; idx < order.size(); idx++)
+            index[order[idx]] = idx;
+        node.firstChild = first;
+        node.nextSibling = -1;
+        node.plusChild = node.plusChild >= 0 ? index[node.plusChild] : -1;
+        nodes.push_back(node);
+    }
+    m_nodes.swap(nodes);
+}
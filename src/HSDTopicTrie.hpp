@@ -0,0 +1,59 @@
+#ifndef HSDTOPICTRIE_H
+#define HSDTOPICTRIE_H
+
+#include <Arduino.h>
+#include <vector>
+
+using namespace std;
+
+#define HSD_TOPIC_MAX_LEVELS 16
+
+/*
+ * Trie over a list of MQTT subscription filters (with '+' and '#' wildcards). A received topic is matched level by
+ * level, the children of a node are sorted by the hash of their names and found by binary search, so the cost hardly
+ * depends on the number of filters. Each filter defines which topic level names the device: the level matched by the
+ * first '+', otherwise the last level. A filter can select another level explicitly with the suffix @<level>
+ * (1 = first level), e.g. "home/+/+/status@3". An '@' anywhere else, or not followed by digits only, is part of the topic.
+ */
+class HSDTopicTrie {
+public:
+    HSDTopicTrie();
+
+    bool                 build(const String& filters); // separated by ',', ';' or whitespace
+    void                 clear();
+    inline const String& getFilter(size_t idx) const { return m_filters[idx].topic; }
+    inline size_t        getFilterCount() const { return m_filters.size(); }
+    inline const String& getSource() const { return m_source; }
+    int                  match(const char* topic, String& device) const; // index of the first matching filter or -1
+
+private:
+    struct Filter {
+        String topic;
+        int8_t deviceLevel; // -1 = last level
+    };
+
+    struct Node {
+        uint16_t childCount; // named children, stored from firstChild on after sortNodes()
+        uint32_t hash;       // of the level name
+        int16_t  filter;     // filter ending at this node, -1 if none
+        int16_t  firstChild;
+        int16_t  hashFilter; // filter with '#' following this node, -1 if none
+        uint8_t  length;     // level name stored in m_filters[nameFilter].topic at nameOffset
+        int16_t  nameFilter;
+        uint8_t  nameOffset;
+        int16_t  nextSibling; // only while the filters are added
+        int16_t  plusChild;  // '+' wildcard child, -1 if none
+    };
+
+    bool addFilter(const String& filter);
+    int  addNode(int parent, int16_t filter, uint8_t offset, uint8_t length);
+    void matchNode(int node, const char* topic, const uint8_t* starts, const uint8_t* lengths, uint8_t level, 
+                   uint8_t levels, int& best) const;
+    void sortNodes();
+
+    vector<Filter> m_filters;
+    vector<Node>   m_nodes; // m_nodes[0] is the root
+    String         m_source;
+};
+
+#endif // HSDTOPICTRIE_H
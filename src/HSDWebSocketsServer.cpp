@@ -0,0 +1,95 @@
+#include "HSDWebSocketsServer.hpp"
+
+#ifdef ESP32
+#include <lwip/sockets.h>
+#endif
+
+HSDWebSocketsServer::HSDWebSocketsServer(uint16_t port) :
+    WebSocketsServer(port)
+{
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDWebSocketsServer::canWrite(uint8_t num, size_t length) {
+    // a small message must fit completely, a large one is fragmented and needs one segment to start with
+    if (num >= WEBSOCKETS_SERVER_CLIENT_MAX || !m_pending[num].data.empty())
+        return false;
+    size_t needed = length + HSD_WS_HEADER_SIZE;
+    return getWritable(num) >= (needed < HSD_WS_WRITE_MIN_FREE ? needed : HSD_WS_WRITE_MIN_FREE);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDWebSocketsServer::discard(uint8_t num) {
+    if (num < WEBSOCKETS_SERVER_CLIENT_MAX)
+        vector<uint8_t>().swap(m_pending[num].data);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+size_t HSDWebSocketsServer::getWritable(uint8_t num) {
+    if (num >= WEBSOCKETS_SERVER_CLIENT_MAX || !clientIsConnected(num) || !_clients[num].tcp)
+        return 0;
+#ifdef ESP8266
+    return _clients[num].tcp->availableForWrite();
+#elif defined(ESP32)
+    // the ESP32 client does not tell the free buffer size, but whether the socket is writable at all, lwIP reports
+    // that above its low water mark, which is more than one segment
+    int fd = _clients[num].tcp->fd();
+    if (fd < 0)
+        return 0;
+    fd_set writeSet;
+    FD_ZERO(&writeSet);
+    FD_SET(fd, &writeSet);
+    struct timeval timeout = {0, 0};
+    return select(fd + 1, nullptr, &writeSet, nullptr, &timeout) > 0 ? HSD_WS_WRITE_MIN_FREE : 0;
+#endif
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDWebSocketsServer::handle() {
+    // continues the fragmented messages, one fragment per client and call
+    for (uint8_t num = 0; num < WEBSOCKETS_SERVER_CLIENT_MAX; num++) {
+        Pending& pending = m_pending[num];
+        if (pending.data.empty())
+            continue;
+        if (!clientIsConnected(num)) {
+            discard(num);
+            continue;
+        }
+        size_t writable = getWritable(num);
+        if (writable <= HSD_WS_HEADER_SIZE)
+            continue;
+        size_t length = pending.data.size() - pending.offset;
+        bool fin = length <= writable - HSD_WS_HEADER_SIZE;
+        if (!fin)
+            length = writable - HSD_WS_HEADER_SIZE;
+        if (!sendFrame(&_clients[num], WSop_continuation, pending.data.data() + pending.offset, length, fin))
+            discard(num);
+        else if (fin)
+            discard(num);
+        else
+            pending.offset += length;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDWebSocketsServer::send(uint8_t num, const uint8_t* payload, size_t length, bool binary) {
+    // callers check canWrite() first, the part not fitting into the send buffer is kept for handle()
+    if (num >= WEBSOCKETS_SERVER_CLIENT_MAX || !clientIsConnected(num) || !m_pending[num].data.empty())
+        return false;
+    WSopcode_t opcode = binary ? WSop_binary : WSop_text;
+    size_t writable = getWritable(num);
+    if (length + HSD_WS_HEADER_SIZE <= writable || writable <= HSD_WS_HEADER_SIZE)
+        return sendFrame(&_clients[num], opcode, const_cast<uint8_t*>(payload), length, true);
+
+    size_t first = writable - HSD_WS_HEADER_SIZE;
+    if (!sendFrame(&_clients[num], opcode, const_cast<uint8_t*>(payload), first, false))
+        return false;
+    m_pending[num].data.assign(payload + first, payload + length);
+    m_pending[num].offset = 0;
+    return true;
+}
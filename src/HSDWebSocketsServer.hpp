@@ -0,0 +1,39 @@
+#ifndef HSDWEBSOCKETSSERVER_H
+#define HSDWEBSOCKETSSERVER_H
+
+#include <WebSocketsServer.h>
+#include <vector>
+
+using namespace std;
+
+#define HSD_WS_WRITE_MIN_FREE 1460 // free send buffer (one TCP segment) needed to start a fragmented message
+#define HSD_WS_HEADER_SIZE    10   // largest header of a frame sent by the server (64 bit length, no mask)
+
+/*
+ * WebSocketsServer telling whether a client can take a message without blocking. The library writes synchronously,
+ * so a message to a client whose TCP window is full stalls the main loop until the data is acknowledged or the
+ * write times out. A message larger than the free send buffer is sent as fragments, each written by handle() when
+ * the connection has room for it.
+ */
+class HSDWebSocketsServer : public WebSocketsServer {
+public:
+    HSDWebSocketsServer(uint16_t port);
+
+    bool        canWrite(uint8_t num, size_t length);
+    void        discard(uint8_t num);
+    void        handle();
+    inline bool send(uint8_t num, const String& payload) { return send(num, reinterpret_cast<const uint8_t*>(payload.c_str()), payload.length(), false); }
+    bool        send(uint8_t num, const uint8_t* payload, size_t length, bool binary);
+
+private:
+    struct Pending {
+        vector<uint8_t> data;   // rest of a fragmented message
+        size_t          offset;
+    };
+
+    size_t  getWritable(uint8_t num);
+
+    Pending m_pending[WEBSOCKETS_SERVER_CLIENT_MAX];
+};
+
+#endif // HSDWEBSOCKETSSERVER_H
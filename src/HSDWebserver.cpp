@@ -12,15 +12,48 @@ extern "C" uint32_t _FS_end;
 #endif
 #include <detail\RequestHandlersImpl.h>
 
+#define FILENAME_IMPORT       "/config.tmp" // uploaded config file while it is validated
+#define IMPORT_NO_FILE        "no file uploaded" // import error until the upload of a file starts
+#define HISTORY_PAGE_SIZE     50
+#define HISTORY_MAX_PAGE_SIZE 500
+#define TEMPLATE_BLOCK_SIZE   512
+#define LED_FRAME_MILLIS      100      // LED frames are sent to the websocket clients at most this often (10 fps)
+#define LED_FRAME_FULL        1        // frame types, a full frame contains all LEDs ...
+#define LED_FRAME_DELTA       2        // ... a delta frame the LEDs changed since the version the client acknowledged
+#define LED_FRAME_HEADER_SIZE 10       // type, version, base version (uint32_t, little endian), number of LEDs
+#define LED_FRAME_ENTRY_SIZE  5        // LED number, red, green, blue, behavior
+#define STATUS_UPDATE_MILLIS  1000     // changed status entries are sent to the websocket clients at most this often
+#define STATUS_BODY_MAX       4096     // larger bodies of POST /api/status are rejected with 413
+#define WS_EVICT_MILLIS       10000    // clients not taking a queued message for that long are disconnected
+#define WS_LOG_BATCH          16       // log lines per websocket message
+#define WS_LOG_LINES          64       // log lines kept for slow clients, a client missing more skips them
+
 // for placeholders 
 using namespace std::placeholders; 
 
-HSDWebserver::HSDWebserver(HSDConfig* config, const HSDLeds* leds, const HSDMqtt* mqtt) :
+HSDWebserver::HSDWebserver(HSDConfig* config, const HSDLeds* leds, const HSDMqtt* mqtt, const HSDJournal* journal) :
     m_config(config),
+    m_configHtmlVersion(0),
+    m_importComplete(false),
+    m_importError(IMPORT_NO_FILE),
+    m_importGroups(0),
+    m_importScanner(nullptr),
+    m_journal(journal),
+    m_ledFrameVersion(1),
+    m_ledSentLast(0),
+    m_ledStateVersion(0),
     m_leds(leds),
+    m_logFirst(0),
     m_mqtt(mqtt),
     m_server(new WebServer(80)),
-    m_ws(new WebSocketsServer(81))
+    m_statusIndexSize(0),
+    m_statusSentLast(0),
+    m_statusVersion(1),
+    m_templateSize(0),
+    m_uptimeMillis(0),
+    m_uptimeMinutes(0),
+    m_ws(new HSDWebSocketsServer(81)),
+    m_wsEvictions(0)
 {
 }
 
@@ -29,6 +62,9 @@ HSDWebserver::HSDWebserver(HSDConfig* config, const HSDLeds* leds, const HSDMqtt
 void HSDWebserver::begin() {
     Logger.log("Starting WebServer");
     
+    buildFileIndex();
+    static const char* headers[] = { "If-None-Match" };
+    m_server->collectHeaders(headers, 1);
     m_ws->onEvent(std::bind(&HSDWebserver::handleWebSocket, this, _1, _2, _3, _4));
     m_server->on("/", HTTP_GET, [=]() {
          sendAndProcessTemplate("/index.html");
@@ -41,6 +77,8 @@ void HSDWebserver::begin() {
             m_server->send(200, "text/html", "<META http-equiv=\"refresh\" content=\"15;URL=/\">Update Success! Rebooting...");
             delay(100);
             m_server->client().stop();
+            if (m_config->isWritePending())
+                m_config->writeConfigFile();
             ESP.restart();
         }
     }, [=]() {
@@ -86,137 +124,51 @@ void HSDWebserver::begin() {
         delay(0);
     });
     m_server->on("/ajax/config.json", HTTP_GET, [=]() {
-        Logger.log("GET /ajax/config.json");
-        DynamicJsonBuffer jsonBuffer;
-        JsonObject& root = jsonBuffer.createObject();
-        JsonArray& gpioArray = root.createNestedArray("gpios");
-#ifdef ARDUINO_ARCH_ESP32
-        const uint8_t maxGpio = 17;
-        const uint8_t gpios[maxGpio] = {2, 4, 5, 12, 13, 14, 15, 16, 17, 18, 19, 23, 25, 26, 27, 32, 33};
-#else    
-        const uint8_t maxGpio = 11;
-        const uint8_t gpios[maxGpio] = {0, 1, 2, 3, 4, 5, 12, 13, 14, 15, 16};
-#endif    
-        for (uint8_t idx = 0; idx < maxGpio; idx++)
-            gpioArray.add(gpios[idx]);        
-        
-        JsonArray& json = root.createNestedArray("entries");
-        auto cfgEntries = m_config->cfgEntries();
-        HSDConfig::Group lastGroup = HSDConfig::Group::__Last;
-        
-        JsonArray* entries = nullptr;
-        for (unsigned int index = 0; index < cfgEntries.size(); index++) {
-            auto entry = cfgEntries[index];
-            if (entry->type != HSDConfig::DataType::ColorMapping && 
-                entry->type != HSDConfig::DataType::DeviceMapping) {
-                if (lastGroup != entry->group) {
-                    lastGroup = entry->group;
-                    JsonObject& obj = json.createNestedObject();
-                    obj["name"] = m_config->groupDescription(entry->group);
-                    entries = &(obj.createNestedArray("entries"));
-                }
-                JsonObject& obj = entries->createNestedObject();
-                obj["key"] = entry->key;
-                obj["label"] = entry->label;
-                if (entry->pattern.length() > 0)
-                    obj["pattern"] = entry->pattern;
-                if (entry->patternMsg.length() > 0)
-                    obj["patternMsg"] = entry->patternMsg;
-                if (entry->maxVal > 0)
-                    obj["maxVal"] = entry->maxVal;
-                obj["type"] = static_cast<int>(entry->type);
-                switch (entry->type) {
-                    case HSDConfig::DataType::String:
-                    case HSDConfig::DataType::Password:
-                        obj["value"] = *entry->value.string;
-                        break;
-                        
-                    case HSDConfig::DataType::Bool:
-                        obj["value"] = *entry->value.boolean;
-                        break;
-                        
-                    case HSDConfig::DataType::Gpio:
-                    case HSDConfig::DataType::Slider:
-                        obj["value"] = *entry->value.byte;
-                        break;
-                        
-                    case HSDConfig::DataType::Word:
-                        obj["value"] = *entry->value.word;
-                        break;
-
-                    case HSDConfig::DataType::ColorMapping:
-                    case HSDConfig::DataType::DeviceMapping:
-                        break;
-                }
-            }
-        }
-        
-        String jsonStr;
-        root.printTo(jsonStr);
-        m_server->send(200, "text/json;charset=utf-8", jsonStr);
+        sendJson("/ajax/config.json", [=](HSDJsonWriter& json) { writeConfig(json); });
     });
     m_server->on("/ajax/colormapping.json", HTTP_GET, [=]() {
-        Logger.log("GET /ajax/colormapping.json");
-        auto colMap = m_config->getColorMap();
-        DynamicJsonBuffer jsonBuffer;
-        JsonArray& colMapping = jsonBuffer.createArray();
-        for (unsigned int index = 0; index < colMap.size(); index++) {
-            JsonObject& colorMappingEntry = colMapping.createNestedObject(); 
-            auto mapping = colMap[index];
-            colorMappingEntry["id"] = index;
-            colorMappingEntry["msg"] = mapping->msg;
-            colorMappingEntry["col"] = m_config->hex2string(mapping->color);
-            colorMappingEntry["beh"] = static_cast<int>(mapping->behavior);
-        }
-        String json;
-        colMapping.printTo(json);
-        m_server->send(200, "text/json;charset=utf-8", json);
+        sendJson("/ajax/colormapping.json", [=](HSDJsonWriter& json) { writeColorMapping(json); });
     });
     m_server->on("/ajax/devicemapping.json", HTTP_GET, [=]() {
-        Logger.log("GET /ajax/devicemapping.json");
-        auto devMap = m_config->getDeviceMap();
-        DynamicJsonBuffer jsonBuffer;
-        JsonArray& devMapping = jsonBuffer.createArray();
-        for (unsigned int index = 0; index < devMap.size(); index++) {
-            JsonObject& deviceMappingEntry = devMapping.createNestedObject(); 
-            auto mapping = devMap[index];
-            deviceMappingEntry["id"] = index;
-            deviceMappingEntry["device"] = mapping->device;
-            deviceMappingEntry["led"] = mapping->ledNumber;
-        }
-        String json;
-        devMapping.printTo(json);
-        m_server->send(200, "text/json;charset=utf-8", json);
+        sendJson("/ajax/devicemapping.json", [=](HSDJsonWriter& json) { writeDeviceMapping(json); });
     });
     m_server->on("/ajax/status.json", HTTP_GET, [=]() {
-        Logger.log("GET /ajax/status.json");
-        DynamicJsonBuffer jsonBuffer;
-        JsonObject& rootObj = jsonBuffer.createObject();
-        JsonArray& types = rootObj.createNestedArray("table");
-        StatusClass type = StatusClass::__Last;
-        JsonArray* entries = nullptr;
-        for (unsigned int index = 0; index < m_statusEntries.size(); index++) {
-            auto entry = m_statusEntries.at(index);
-            if (entry->type != type) {
-                type = entry->type;
-                JsonObject& typeObj = types.createNestedObject();
-                typeObj["name"] = getTypeName(entry->type);
-                entries = &(typeObj.createNestedArray("entries"));
-            }
-            JsonObject& obj = entries->createNestedObject();
-            obj["label"] = entry->label;
-            obj["value"] = entry->value;
-            if (entry->unit.length() > 0)
-                obj["unit"] = entry->unit;
-            if (entry->id.length() > 0)
-                obj["id"] = entry->id;
+        sendJson("/ajax/status.json", [=](HSDJsonWriter& json) { writeStatus(json); });
+    });
+    m_server->on("/ajax/history", HTTP_GET, std::bind(&HSDWebserver::sendHistory, this));
+    m_server->on("/api/config", HTTP_GET, [=]() {
+        // export, serialized from the configuration in memory, so pending edits are included
+        m_server->sendHeader("Content-Disposition", "attachment; filename=config.json");
+        sendJson("/api/config", [=](HSDJsonWriter& json) { m_config->writeJson(json); });
+    });
+    m_server->on("/api/config", HTTP_POST, [=]() {
+        bool success = m_importComplete && m_config->importConfigFile(FILENAME_IMPORT);
+        if (m_importComplete && !success)
+            m_importError = "failed to replace the config file";
+        SPIFFS.remove(FILENAME_IMPORT);
+        Logger.log("POST /api/config: %s", success ? "imported" : m_importError.c_str());
+        String json = success ? "{\"success\":true}" : "{\"success\":false,\"error\":\"" + m_importError + "\"}";
+        m_server->send(success ? 200 : 400, "text/json;charset=utf-8", json);
+        m_importComplete = false;
+        m_importError = IMPORT_NO_FILE; // for the next request, a file part clears it
+    }, std::bind(&HSDWebserver::handleConfigUpload, this));
+    m_server->on("/metrics", HTTP_GET, std::bind(&HSDWebserver::sendMetrics, this));
+    m_server->on("/api/status", HTTP_POST, [=]() {
+        // direct status updates, the body has the same format as a bulk status message
+        const String& body = m_server->arg("plain");
+        Logger.log("POST /api/status (%u bytes)", body.length());
+        if (body.length() > STATUS_BODY_MAX) {
+            // the web server reads the body into one String, clients have to split larger updates
+            m_server->send(413, "text/json;charset=utf-8", "{\"success\":false,\"error\":\"body too large\"}");
+            return;
         }
-        JsonArray& leds = rootObj.createNestedArray("leds");
-        createLedArray(leds);
-        
-        String jsonStr;
-        rootObj.printTo(jsonStr);
-        m_server->send(200, "text/json;charset=utf-8", jsonStr);
+        unsigned int entries = 0;
+        unsigned int updates = 0;
+        bool success = m_statusCallback && m_statusCallback(body.c_str(), body.length(), entries, updates);
+        char json[64];
+        snprintf(json, sizeof(json), "{\"entries\":%u,\"updates\":%u,\"success\":%s}", entries, updates, 
+                 success ? "true" : "false");
+        m_server->send(success ? 200 : 400, "text/json;charset=utf-8", json);
     });
     m_server->onNotFound(std::bind(&HSDWebserver::deliverNotFoundPage, this));
     m_server->begin();
@@ -235,6 +187,9 @@ void HSDWebserver::begin() {
 #endif
     m_statusEntries.push_back(new StatusEntry(StatusClass::Device, "CPU", buffer));
     m_statusEntries.push_back(new StatusEntry(StatusClass::Device, "Uptime", getUptimeString(uptime), "", "uptime"));
+    m_statusEntries.push_back(new StatusEntry(StatusClass::Device, "Rules", "-", "", "rules"));
+    m_statusEntries.push_back(new StatusEntry(StatusClass::Device, "Status journal", "-", "", "journal"));
+    m_statusEntries.push_back(new StatusEntry(StatusClass::Device, "Loop time (last minute)", "-", "", "loop"));
 #ifdef ESP8266
     m_statusEntries.push_back(new StatusEntry(StatusClass::Device, "Voltage", String(ESP.getVcc()), "mV", "voltage"));
     snprintf(buffer, 64, "%08X", ESP.getChipId());
@@ -258,8 +213,17 @@ void HSDWebserver::begin() {
     m_statusEntries.push_back(new StatusEntry(StatusClass::Network, "IP address", WiFi.localIP().toString(), "", "ip"));
     m_statusEntries.push_back(new StatusEntry(StatusClass::Network, "Subnet Mask", WiFi.subnetMask().toString(), "", "subnetMask"));
     m_statusEntries.push_back(new StatusEntry(StatusClass::Network, "Gateway", WiFi.gatewayIP().toString(), "", "gateway"));
+    m_statusEntries.push_back(new StatusEntry(StatusClass::Network, "WebSocket queues", "-", "", "wsQueues"));
+    m_statusEntries.push_back(new StatusEntry(StatusClass::Network, "HTTP file transfers", "-", "", "httpTransfers"));
+    if (m_config->getLedStreamPort() > 0)
+        m_statusEntries.push_back(new StatusEntry(StatusClass::Network, "Pixel stream", "idle", "", "ledStream"));
     m_statusEntries.push_back(new StatusEntry(StatusClass::Mqtt, "Server", m_config->getMqttServer() + ":" + String(m_config->getMqttPort())));
     m_statusEntries.push_back(new StatusEntry(StatusClass::Mqtt, "Status", m_mqtt->connected() ? "Connected" : "Disconnected", "", "mqttStatus"));
+    m_statusEntries.push_back(new StatusEntry(StatusClass::Mqtt, "Connect attempts", "-", "", "mqttConnect"));
+    m_statusEntries.push_back(new StatusEntry(StatusClass::Mqtt, "Publish queue", "-", "", "mqttQueue"));
+    m_statusEntries.push_back(new StatusEntry(StatusClass::Mqtt, "Large messages", "limit " + String(m_config->getMqttMaxPayload()) + " bytes", "", "mqttLarge"));
+    m_statusEntries.push_back(new StatusEntry(StatusClass::Mqtt, "Status entries per minute", "-", "", "statusRates"));
+    m_statusEntries.push_back(new StatusEntry(StatusClass::Mqtt, "Last retained sync", "-", "", "mqttSync"));
 #ifdef ESP8266
     snprintf(buffer, 64, "%08X", ESP.getFlashChipId());
     m_statusEntries.push_back(new StatusEntry(StatusClass::Flash, "Chip ID", buffer));
@@ -292,15 +256,24 @@ void HSDWebserver::begin() {
 // ---------------------------------------------------------------------------------------------------------------------
 
 void HSDWebserver::updateStatusEntry(const String& id, const String& value) {
-    for (size_t idx = 0; idx < m_statusEntries.size(); idx++)
-        if (m_statusEntries[idx]->id == id)
-            m_statusEntries[idx]->value = value;
+    if (m_statusIndexSize != m_statusEntries.size())
+        buildStatusIndex();
+    int idx = m_statusIndex.find(id);
+    if (idx < 0 || m_statusIndexEntries[idx]->id != id)
+        return;
+    StatusEntry* entry = m_statusIndexEntries[idx];
+    if (entry->value != value) {
+        entry->value = value;
+        entry->version = ++m_statusVersion;
+    }
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
 
 void HSDWebserver::setUptime(unsigned long& deviceUptime) {
-    Serial.printf("setUptime(%lu) - ", deviceUptime);
+    Logger.log("setUptime(%lu)", deviceUptime);
+    m_uptimeMillis = millis();
+    m_uptimeMinutes = deviceUptime;
     updateStatusEntry("rssi", String(WiFi.RSSI()));
     updateStatusEntry("uptime", getUptimeString(deviceUptime));
 #ifdef ESP32
@@ -314,47 +287,219 @@ void HSDWebserver::setUptime(unsigned long& deviceUptime) {
     updateStatusEntry("maxFreeBlock", String(ESP.getMaxFreeBlockSize()));
     updateStatusEntry("voltage", String(ESP.getVcc()));
 #endif
-    
-    if (m_ws->connectedClients()) {
-        String res = createUpdateRequest();
-        Logger.log("setUptime(%lu) - %u client: '%s'", deviceUptime, m_ws->connectedClients(), res.c_str());
-        m_ws->broadcastTXT(res);
-    } else {
-        Logger.log("setUptime(%lu) - no websocket connected", deviceUptime);
+
+    // largest queue depth per client during the last interval
+    String queues;
+    for (uint8_t num = 0; num < WEBSOCKETS_SERVER_CLIENT_MAX; num++) {
+        if (m_ws->clientIsConnected(num)) {
+            queues += queues.length() > 0 ? ", #" : "#";
+            queues += String(num) + ": " + String(m_wsClients[num].maxDepth);
+            m_wsClients[num].maxDepth = getQueueDepth(num);
+        }
     }
+    if (queues.length() == 0)
+        queues = "no clients";
+    updateStatusEntry("wsQueues", queues + ", " + String(m_wsEvictions) + " disconnected");
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%u active, %u completed, %u aborted", (unsigned int)m_fileSender.getActive(), 
+             (unsigned int)m_fileSender.getCompleted(), (unsigned int)m_fileSender.getAborted());
+    updateStatusEntry("httpTransfers", buffer);
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
 
-void HSDWebserver::createLedArray(JsonArray& leds) const {
-    uint8_t idx(0);
-    for (int ledNr = 0; ledNr < m_config->getNumberOfLeds(); ledNr++) {
-        uint32_t color = m_leds->getColor(ledNr);
-        HSDConfig::Behavior behavior = m_leds->getBehavior(ledNr);
-        if ((LED_COLOR_NONE != color) && (HSDConfig::Behavior::Off != behavior)) {
-            JsonObject& ledObj = leds.createNestedObject();
-            ledObj["id"] = idx++;
-            ledObj["led"] = ledNr;
-            ledObj["device"] = m_config->getDevice(ledNr);
-            ledObj["col"] = m_config->hex2string(color);
-            ledObj["beh"] = static_cast<int>(behavior);
+void HSDWebserver::buildFileIndex() {
+    // static files only change with a file system update (followed by a restart)
+    vector<String> names;
+#ifdef ESP8266
+    Dir dir = SPIFFS.openDir("/");
+    while (dir.next())
+        names.push_back(dir.fileName());
+#elif defined(ESP32)
+    File root = SPIFFS.open("/");
+    File entry;
+    while ((entry = root.openNextFile())) {
+        names.push_back(entry.name());
+        entry.close();
+    }
+    root.close();
+#endif
+
+    m_staticFiles.clear();
+    uint8_t block[TEMPLATE_BLOCK_SIZE];
+    for (const String& name : names) {
+        if (name.endsWith(".json") || name == FILENAME_MAINCONFIG_NEW || name == FILENAME_IMPORT || 
+            name == FILENAME_JOURNAL || name == FILENAME_JOURNAL_OLD || name == FILENAME_JOURNAL_TMP)
+            continue; // written at runtime
+
+        File file = SPIFFS.open(name, "r");
+        if (!file)
+            continue;
+        StaticFile staticFile;
+        staticFile.gzip = name.endsWith(".gz");
+        staticFile.path = staticFile.gzip ? name.substring(0, name.length() - 3) : name;
+        staticFile.size = file.size();
+        uint32_t hash = 2166136261u; // FNV-1a
+        int length;
+        while ((length = file.read(block, sizeof(block))) > 0) {
+            for (int idx = 0; idx < length; idx++) {
+                hash ^= block[idx];
+                hash *= 16777619u;
+            }
         }
-    }        
+        file.close();
+        char etag[24];
+        snprintf(etag, sizeof(etag), "\"%x-%08x\"", (unsigned int)staticFile.size, (unsigned int)hash);
+        staticFile.etag = etag;
+#ifdef ESP8266            
+        staticFile.contentType = esp8266webserver::StaticRequestHandler<WiFiServer>::getContentType(staticFile.path);
+#elif defined ESP32
+        staticFile.contentType = StaticRequestHandler::getContentType(staticFile.path);
+#endif            
+        m_staticFiles.push_back(staticFile);
+    }
+    Logger.log("Indexed %u static files", (unsigned int)m_staticFiles.size());
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
 
-String HSDWebserver::createUpdateRequest() const {
-    DynamicJsonBuffer jsonBuffer;
-    JsonObject& json = jsonBuffer.createObject();
-    json["method"] = "update";
-    JsonObject& fields = json.createNestedObject("fields");
-    for (size_t idx = 0; idx < m_statusEntries.size(); idx++)
-        if (m_statusEntries[idx]->id.length() > 0)
-            fields[m_statusEntries[idx]->id] = m_statusEntries[idx]->value;
-       
+void HSDWebserver::buildStatusIndex() {
+    // entries are registered during start, afterwards the index is only used for lookups
+    vector<const String*> keys;
+    m_statusIndexEntries.clear();
+    for (StatusEntry* entry : m_statusEntries) {
+        if (entry->id.length() > 0) {
+            keys.push_back(&entry->id);
+            m_statusIndexEntries.push_back(entry);
+        }
+    }
+    if (!m_statusIndex.build(keys))
+        Logger.log("Failed to build the status entry index");
+    m_statusIndexSize = m_statusEntries.size();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HSDWebserver::canSend(uint8_t num, size_t length) {
+    // queued messages stay queued (and are replaced by newer state) until the client can take them without blocking
+    if (!m_ws->canWrite(num, length))
+        return false;
+    m_wsClients[num].writableLast = millis();
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDWebserver::captureLedFrame() {
+    // a stream changes the stripe without changing the LED state, so its pixels are compared on every capture
+    bool streaming = m_leds->isStreaming();
+    uint8_t numLeds = m_config->getNumberOfLeds();
+    if (!streaming && m_ledStateVersion == m_leds->getStateVersion() && m_ledFrame.size() == numLeds)
+        return;
+    m_ledStateVersion = streaming ? 0 : m_leds->getStateVersion();
+
+    if (m_ledFrame.size() != numLeds) {
+        m_ledFrameVersion++;
+        m_ledFrame.assign(numLeds, 0);
+        m_ledVersions.assign(numLeds, m_ledFrameVersion);
+        for (WsClient& client : m_wsClients)
+            client.ledAcked = 0;
+    }
+    bool changed(false);
+    for (uint8_t led = 0; led < numLeds; led++) {
+        uint32_t value = streaming ? (m_leds->getPixelColor(led) << 8) | static_cast<uint8_t>(HSDConfig::Behavior::On) :
+                         ((m_leds->getColor(led) & 0xFFFFFF) << 8) | static_cast<uint8_t>(m_leds->getBehavior(led));
+        if (value != m_ledFrame[led]) {
+            if (!changed)
+                m_ledFrameVersion++;
+            changed = true;
+            m_ledFrame[led] = value;
+            m_ledVersions[led] = m_ledFrameVersion;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDWebserver::checkWsClients() {
+    for (uint8_t num = 0; num < WEBSOCKETS_SERVER_CLIENT_MAX; num++) {
+        if (!m_ws->clientIsConnected(num))
+            continue;
+        WsClient& client = m_wsClients[num];
+        size_t depth = getQueueDepth(num);
+        if (depth > client.maxDepth)
+            client.maxDepth = depth;
+        if (depth == 0)
+            client.writableLast = millis();
+
+        // the client reconnects and starts again with a full update
+        if (millis() - client.writableLast >= WS_EVICT_MILLIS) {
+            Logger.log("ws[%u] disconnected, %u messages queued", num, static_cast<unsigned int>(depth));
+            m_wsEvictions++;
+            m_ws->disconnect(num);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDWebserver::compileTemplate(const String& filePath, File& file) {
+    // split the template into literal text and placeholders (%KEY%), so a request only copies blocks of the file
+    m_templatePath = filePath;
+    m_templateSegments.clear();
+    m_templateSize = file.size();
+    uint8_t block[TEMPLATE_BLOCK_SIZE];
+    uint32_t pos(0), segmentStart(0), keyStart(0);
+    bool inKey(false);
+    String key;
+    int length;
+    while ((length = file.read(block, sizeof(block))) > 0) {
+        for (int idx = 0; idx < length; idx++, pos++) {
+            if (block[idx] != '%') {
+                if (inKey)
+                    key += char(block[idx]);
+            } else if (!inKey) {
+                inKey = true;
+                keyStart = pos;
+                key = "";
+            } else {
+                Placeholder placeholder(Placeholder::None);
+                if (key == "CONFIG")
+                    placeholder = Placeholder::Config;
+                else if (key == "VERSION")
+                    placeholder = Placeholder::Version;
+                else
+                    Logger.log("Unknown placeholder %s in %s", key.c_str(), filePath.c_str());
+                m_templateSegments.push_back(TemplateSegment{segmentStart, keyStart - segmentStart, placeholder});
+                segmentStart = pos + 1;
+                inKey = false;
+            }
+        }
+    }
+    if (inKey) {
+        Logger.log("Cannot process %s: unable to parse", filePath.c_str());
+        pos = keyStart;
+    }
+    m_templateSegments.push_back(TemplateSegment{segmentStart, pos - segmentStart, Placeholder::None});
+    Logger.log("Compiled template %s (%u bytes, %u segments)", filePath.c_str(), m_templateSize, 
+               m_templateSegments.size());
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+String HSDWebserver::createUpdateRequest(uint32_t since) const {
+    // entries changed after the given status version, all entries for 0
     String res;
-    json.printTo(res);
+    HSDJsonWriter json([&res](const char* data, size_t length) { res.concat(data, length); });
+    json.beginObject();
+    json.addString("method", "update");
+    json.beginObject("fields");
+    for (size_t idx = 0; idx < m_statusEntries.size(); idx++)
+        if (m_statusEntries[idx]->id.length() > 0 && (since == 0 || m_statusEntries[idx]->version > since))
+            json.addString(m_statusEntries[idx]->id.c_str(), m_statusEntries[idx]->value);
+    json.endObject();
+    json.endObject();
+    json.flush();
     return res;
 }
 
@@ -378,6 +523,67 @@ void HSDWebserver::deliverNotFoundPage() {
 
 // ---------------------------------------------------------------------------------------------------------------------
 
+void HSDWebserver::editTable(const String& table, const JsonArray& ops) const {
+    // row operations applied in place, the indexes are rebuilt once per message and the file written deferred
+    bool colors = table == "colorMapping";
+    if (!colors && table != "deviceMapping") {
+        Logger.log("Unknown table to edit: %s", table.c_str());
+        return;
+    }
+    size_t applied(0);
+    for (size_t idx = 0; idx < ops.size(); idx++) {
+        const JsonObject& op = ops.get<JsonVariant>(idx).as<JsonObject>();
+        String type = op["op"];
+        size_t index = op["index"].as<unsigned int>();
+        bool success(false);
+        if (type == "insert")
+            success = colors ? m_config->insertColorMapping(index, parseColorMapping(op["row"].as<JsonObject>())) :
+                               m_config->insertDeviceMapping(index, parseDeviceMapping(op["row"].as<JsonObject>()));
+        else if (type == "update")
+            success = colors ? m_config->updateColorMapping(index, parseColorMapping(op["row"].as<JsonObject>())) :
+                               m_config->updateDeviceMapping(index, parseDeviceMapping(op["row"].as<JsonObject>()));
+        else if (type == "delete")
+            success = colors ? m_config->deleteColorMapping(index) : m_config->deleteDeviceMapping(index);
+        else if (type == "move")
+            success = colors ? m_config->moveColorMapping(index, op["to"].as<unsigned int>()) : 
+                               m_config->moveDeviceMapping(index, op["to"].as<unsigned int>());
+        if (success)
+            applied++;
+        else
+            Logger.log("Failed to %s row %u of %s", type.c_str(), static_cast<unsigned int>(index), table.c_str());
+    }
+    Logger.log("Edit %s: %u of %u row operations applied", table.c_str(), static_cast<unsigned int>(applied), 
+               static_cast<unsigned int>(ops.size()));
+    if (applied > 0) {
+        m_config->updateMapIndexes();
+        m_config->writeConfigFileDeferred();
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+const HSDWebserver::StaticFile* HSDWebserver::findStaticFile(const String& path) const {
+    for (const StaticFile& staticFile : m_staticFiles)
+        if (staticFile.path == path)
+            return &staticFile;
+    return nullptr;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+size_t HSDWebserver::getQueueDepth(uint8_t num) const {
+    // LED frame and status update are one message each, however many changes they carry
+    const WsClient& client = m_wsClients[num];
+    size_t depth = m_logFirst + m_logLines.size() - client.logNext;
+    if (client.ledSent != m_ledFrameVersion)
+        depth++;
+    if (client.statusVersion != m_statusVersion)
+        depth++;
+    return depth;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
 String HSDWebserver::getConfig() const {
     String tabs = "\n              <div class=\"mdl-tabs__tab-bar\">\n";
     String form = "\n              <form id=\"formConfig\">";
@@ -436,7 +642,95 @@ String HSDWebserver::getUptimeString(unsigned long& uptime) const {
 
 // ---------------------------------------------------------------------------------------------------------------------
 
+void HSDWebserver::handle() {
+    m_server->handleClient();
+    m_fileSender.handle();
+    m_ws->loop();
+    m_ws->handle();
+    sendLedUpdates();
+    sendStatusUpdates();
+    sendLogLines();
+    checkWsClients();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDWebserver::handleConfigUpload() {
+    // the upload is validated while it is written to a temp file, the config is only replaced if it is complete
+    HTTPUpload& upload = m_server->upload();
+    if (upload.status == UPLOAD_FILE_START) {
+        Logger.log("Import config: %s", upload.filename.c_str());
+        m_importComplete = false;
+        m_importError = String();
+        m_importGroups = 0;
+        m_importFile = SPIFFS.open(FILENAME_IMPORT, "w");
+        if (!m_importFile)
+            m_importError = "failed to open " FILENAME_IMPORT;
+        delete m_importScanner;
+        m_importScanner = new HSDJsonScanner([this](HSDJsonScanner::Token token, uint8_t depth, const char* text, size_t) {
+            if (depth == 0 && token != HSDJsonScanner::Token::ObjectStart && token != HSDJsonScanner::Token::ObjectEnd) {
+                m_importError = "not a JSON object";
+            } else if (depth == 1 && token == HSDJsonScanner::Token::Key) {
+                for (uint8_t group = 0; group < static_cast<uint8_t>(HSDConfig::Group::__Last); group++) {
+                    String groupName = m_config->groupDescription(static_cast<HSDConfig::Group>(group));
+                    groupName.toLowerCase();
+                    if (groupName == text)
+                        m_importGroups++;
+                }
+            }
+        });
+    } else if (upload.status == UPLOAD_FILE_WRITE && !m_importError.length()) {
+        if (!m_importScanner->feed(reinterpret_cast<const char*>(upload.buf), upload.currentSize))
+            m_importError = "invalid JSON";
+        else if (m_importFile.write(upload.buf, upload.currentSize) != upload.currentSize)
+            m_importError = "failed to write " FILENAME_IMPORT;
+    } else if (upload.status == UPLOAD_FILE_END || upload.status == UPLOAD_FILE_ABORTED) {
+        if (upload.status == UPLOAD_FILE_ABORTED)
+            m_importError = "upload aborted";
+        else if (!m_importError.length() && (!m_importScanner->finish() || !m_importScanner->isComplete()))
+            m_importError = "incomplete JSON";
+        else if (!m_importError.length() && m_importGroups == 0)
+            m_importError = "no configuration groups found";
+        m_importComplete = !m_importError.length();
+        if (m_importFile)
+            m_importFile.close();
+        delete m_importScanner;
+        m_importScanner = nullptr;
+        Logger.log("Import config: %u bytes", (unsigned int)upload.totalSize);
+    }
+    delay(0);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
 bool HSDWebserver::handleFileRead(String path) {
+    const StaticFile* staticFile = findStaticFile(path);
+    if (staticFile) {
+        // the asset URLs are not versioned, so every file is revalidated by its ETag
+        m_server->sendHeader("ETag", staticFile->etag);
+        m_server->sendHeader("Cache-Control", "no-cache");
+        if (m_server->header("If-None-Match") == staticFile->etag) {
+            Logger.log("handleFileRead: %s not modified", path.c_str());
+            m_server->send(304);
+            return true;
+        }
+        Logger.log("handleFileRead: %s%s", path.c_str(), staticFile->gzip ? ".gz" : "");
+        File file = SPIFFS.open(staticFile->gzip ? path + ".gz" : path, "r");
+        if (file && file.size() > HSD_FILE_SENDER_SLICE && m_fileSender.canAdd()) {
+            // only the headers are sent here, the content follows in slices from handle()
+            if (staticFile->gzip)
+                m_server->sendHeader("Content-Encoding", "gzip");
+            m_server->setContentLength(file.size());
+            m_server->send(200, staticFile->contentType, "");
+            m_fileSender.add(m_server->client(), file);
+        } else {
+            m_server->streamFile(file, staticFile->contentType);
+            file.close();
+        }
+        return true;
+    }
+
+    // files not in the index (the configuration and files written at runtime)
     String filepath;
     if (SPIFFS.exists(path)) { 
         Logger.log("handleFileRead: %s", path.c_str());
@@ -459,7 +753,6 @@ bool HSDWebserver::handleFileRead(String path) {
             contentType = StaticRequestHandler::getContentType(path);
 #endif            
         }
-//        m_server.sendHeader("Cache-Control", "max-age=86400");
         File file = SPIFFS.open(filepath, "r");
         m_server->streamFile(file, contentType);
         file.close();
@@ -475,11 +768,21 @@ void HSDWebserver::handleWebSocket(uint8_t num, WStype_t type, uint8_t * payload
     if (type == WStype_CONNECTED) {
         Logger.log("ws[%u] connect from %s", num, m_ws->remoteIP(num).toString().c_str());
         m_ws->sendPing(num);
-        String payload = createUpdateRequest();
-        m_ws->sendTXT(num, payload);
+        WsClient& client = m_wsClients[num];
+        client.buffer = "";
+        client.devicesSent = false;
+        client.ledAcked = 0;
+        client.ledSent = 0;
+        client.logNext = m_logFirst;
+        client.maxDepth = 0;
+        client.writableLast = millis();
+        String payload = createUpdateRequest(0);
+        if (canSend(num, payload.length()) && m_ws->send(num, payload))
+            client.statusVersion = m_statusVersion;
         Logger.send();
     } else if (type == WStype_DISCONNECTED) {
         Logger.log("ws[%u] disconnect", num);
+        m_ws->discard(num);
     } else if (type == WStype_ERROR) {
         Logger.log("ws[%u] error: %s", num, length ? reinterpret_cast<const char*>(payload): "");
     } else if (type == WStype_PONG) {
@@ -487,33 +790,45 @@ void HSDWebserver::handleWebSocket(uint8_t num, WStype_t type, uint8_t * payload
             Logger.log("ws[%u] pong[%u]: %s", num, length, reinterpret_cast<const char*>(payload));
         else
             Logger.log("ws[%u] pong[%u]", num, length);
+    } else if (type == WStype_BIN) {
+        // acknowledged LED frame version (uint32_t, little endian), sent for every frame so not logged
+        if (length == 4) {
+            uint32_t version = payload[0] | (payload[1] << 8) | (payload[2] << 16) | (static_cast<uint32_t>(payload[3]) << 24);
+            WsClient& client = m_wsClients[num];
+            if (version > client.ledAcked && version <= client.ledSent)
+                client.ledAcked = version;
+        }
     } else if (type == WStype_TEXT) {
         Logger.log("ws[%u] text received: %s", num, reinterpret_cast<const char*>(payload));
-        m_wsBuffer[num] = reinterpret_cast<const char*>(payload);
+        m_wsClients[num].buffer = reinterpret_cast<const char*>(payload);
         msgReceived = true;
     } else if (type == WStype_FRAGMENT_TEXT_START) {
         Logger.log("ws[%u] text fragment start: %s", num, reinterpret_cast<const char*>(payload));
-        m_wsBuffer[num] = reinterpret_cast<const char*>(payload);
+        m_wsClients[num].buffer = reinterpret_cast<const char*>(payload);
     } else if (type == WStype_FRAGMENT) {
         Logger.log("ws[%u] text fragment: %s", num, reinterpret_cast<const char*>(payload));
-        m_wsBuffer[num] += reinterpret_cast<const char*>(payload);
+        m_wsClients[num].buffer += reinterpret_cast<const char*>(payload);
     } else if (type == WStype_FRAGMENT_FIN) {
         Logger.log("ws[%u] text fragment: %s", num, reinterpret_cast<const char*>(payload));
-        m_wsBuffer[num] += reinterpret_cast<const char*>(payload);
+        m_wsClients[num].buffer += reinterpret_cast<const char*>(payload);
         msgReceived = true;
     } else {
         Logger.log("ws[%u] - event %u", num, type);
     }
     
     if (msgReceived) {
-        DynamicJsonBuffer jsonBuffer(m_wsBuffer[num].length() + 1);
-        JsonObject& reqObj = jsonBuffer.parseObject(m_wsBuffer[num]);
+        DynamicJsonBuffer jsonBuffer(m_wsClients[num].buffer.length() + 1);
+        JsonObject& reqObj = jsonBuffer.parseObject(m_wsClients[num].buffer);
         String method = reqObj["method"];
-        if (method == "importCfg") {
-            importConfig(reqObj["filename"], reqObj["data"]);
+        if (method == "editTable") {
+            editTable(reqObj["table"], reqObj["ops"].as<const JsonArray&>());
         } else if (method == "reboot") {
             Logger.log("Rebooting ESP...");
+            if (m_config->isWritePending())
+                m_config->writeConfigFile();
             ESP.restart();
+        } else if (method == "resync") {
+            m_wsClients[num].statusVersion = 0; // all entries with the next update
         } else if (method == "saveCfg") {
             saveConfig(reqObj["data"].as<const JsonObject&>());
         } else if (method == "updateTable") {
@@ -527,75 +842,61 @@ void HSDWebserver::handleWebSocket(uint8_t num, WStype_t type, uint8_t * payload
         } else {
             Logger.log("Unknown webSocket method: %s", method.c_str());
         }
-        m_wsBuffer[num] = ""; // cleanup memory
+        m_wsClients[num].buffer = ""; // cleanup memory
     }
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
 
-void HSDWebserver::importConfig(const String& filename, const String& content) const {
-    Logger.log("Import config: %s", filename.c_str());
-    File file = SPIFFS.open(FILENAME_MAINCONFIG, "w+");
-    if (!file) {
-        Logger.log("Failed to open %s", FILENAME_MAINCONFIG);
-    } else {
-#ifdef ESP8266
-        if (file.write(content.c_str()) != content.length())
-#elif defined(ESP32)
-        if (file.write(reinterpret_cast<const uint8_t*>(content.c_str()), content.length()) != content.length())
-#endif            
-            Logger.log("Failed to write file");
-        file.close();
-        m_config->readConfigFile();
+bool HSDWebserver::log(vector<String> lines) {
+    // queued for the clients and sent in batches by sendLogLines()
+    if (!m_ws->connectedClients())
+        return false;
+    for (const String& line : lines)
+        m_logLines.push_back(line);
+    if (m_logLines.size() > WS_LOG_LINES) { // clients still missing the dropped lines skip them
+        size_t drop = m_logLines.size() - WS_LOG_LINES;
+        m_logLines.erase(m_logLines.begin(), m_logLines.begin() + drop);
+        m_logFirst += drop;
     }
-}    
+    return true;
+}
 
 // ---------------------------------------------------------------------------------------------------------------------
 
-void HSDWebserver::ledChange() {
-    if (m_ws->connectedClients()) {
-        DynamicJsonBuffer jsonBuffer;
-        JsonObject& json = jsonBuffer.createObject();
-        json["method"] = "updLeds";
-        createLedArray(json.createNestedArray("data"));
-    
-        String res;
-        json.printTo(res);
-        m_ws->broadcastTXT(res);
+const String& HSDWebserver::getPlaceholder(Placeholder placeholder) {
+    static const String version("V" HSD_VERSION);
+    static const String empty;
+    switch (placeholder) {
+        case Placeholder::Config:
+            if (m_configHtml.length() == 0 || m_configHtmlVersion != m_config->getConfigVersion()) {
+                m_configHtml = getConfig();
+                m_configHtmlVersion = m_config->getConfigVersion();
+            }
+            return m_configHtml;
+        case Placeholder::Version:
+            return version;
+        case Placeholder::None:
+            break;
     }
+    return empty;
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
 
-bool HSDWebserver::log(vector<String> lines) {
-    if (m_ws->connectedClients()) {
-        DynamicJsonBuffer jsonBuffer;
-        JsonObject& json = jsonBuffer.createObject();
-        json["method"] = "log";
-        JsonArray& linesJson = json.createNestedArray("lines");
-        for (String line : lines)
-            linesJson.add(line);
-        
-        String res;
-        json.printTo(res);
-        m_ws->broadcastTXT(res);
-        return true;
-    }
-    return false;
+HSDConfig::ColorMapping HSDWebserver::parseColorMapping(const JsonObject& elem) const {
+    return HSDConfig::ColorMapping(elem["msg"].as<String>(), 
+                                   m_config->string2hex(elem["col"].as<String>()), 
+                                   static_cast<HSDConfig::Behavior>(elem["beh"].is<int>() ? elem["beh"].as<int>() : elem["beh"].as<String>().toInt()));
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
 
-String HSDWebserver::processTemplates(const String& key) const {
-    Logger.log("processTemplates(%s)", key.c_str());
-    if (key == "CONFIG") {
-        return getConfig();
-    } else if (key == "VERSION") {
-        return "V" HSD_VERSION;
-    } else {
-        Serial.println("UNKNOWN KEY");
-        return "";
-    }
+HSDConfig::DeviceMapping HSDWebserver::parseDeviceMapping(const JsonObject& elem) const {
+    return HSDConfig::DeviceMapping(elem["device"].as<String>(), 
+                                    elem["led"].is<int>() ? elem["led"].as<int>() : elem["led"].as<String>().toInt(),
+                                    elem["path"].is<const char*>() ? elem["path"].as<String>() : String(),
+                                    elem["debounce"].is<int>() ? elem["debounce"].as<int>() : elem["debounce"].as<String>().toInt());
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
@@ -605,12 +906,8 @@ void HSDWebserver::saveColorMapping(const JsonArray& colMapping) const {
     colMapping.printTo(Logger);
     Logger.println();
     vector<HSDConfig::ColorMapping*> colMap;
-    for (size_t i = 0; i < colMapping.size(); i++) {
-        const JsonObject& elem = colMapping.get<JsonVariant>(i).as<JsonObject>();
-        colMap.push_back(new HSDConfig::ColorMapping(elem["msg"].as<String>(), 
-                                                     m_config->string2hex(elem["col"].as<String>()), 
-                                                     static_cast<HSDConfig::Behavior>(elem["beh"].is<int>() ? elem["beh"].as<int>() : elem["beh"].as<String>().toInt())));
-    }
+    for (size_t i = 0; i < colMapping.size(); i++)
+        colMap.push_back(new HSDConfig::ColorMapping(parseColorMapping(colMapping.get<JsonVariant>(i).as<JsonObject>())));
     m_config->setColorMap(colMap);
     m_config->writeConfigFile();
 }
@@ -685,11 +982,8 @@ void HSDWebserver::saveDeviceMapping(const JsonArray& devMapping) const {
     devMapping.printTo(Logger);
     Logger.println();
     vector<HSDConfig::DeviceMapping*> devMap;
-    for (size_t i = 0; i < devMapping.size(); i++) {
-        const JsonObject& elem = devMapping.get<JsonVariant>(i).as<JsonObject>();
-        devMap.push_back(new HSDConfig::DeviceMapping(elem["device"].as<String>(), 
-                                                      elem["led"].is<int>() ? elem["led"].as<int>() : elem["led"].as<String>().toInt()));
-    }
+    for (size_t i = 0; i < devMapping.size(); i++)
+        devMap.push_back(new HSDConfig::DeviceMapping(parseDeviceMapping(devMapping.get<JsonVariant>(i).as<JsonObject>())));
     m_config->setDeviceMap(devMap);
     m_config->writeConfigFile();
 }
@@ -697,73 +991,236 @@ void HSDWebserver::saveDeviceMapping(const JsonArray& devMapping) const {
 // ---------------------------------------------------------------------------------------------------------------------
 
 void HSDWebserver::sendAndProcessTemplate(const String& filePath) {
-    if (!SPIFFS.exists(filePath)) {
+    File file;
+    if (SPIFFS.exists(filePath))
+        file = SPIFFS.open(filePath, "r");
+    if (!file) {
         Logger.log("Cannot process %s: file does not exist", filePath.c_str());
         deliverNotFoundPage();
-    } else {
-        File file = SPIFFS.open(filePath, "r");
-        if (!file) {
-            Logger.log("Cannot process %s: file does not exist", filePath.c_str());
-            deliverNotFoundPage();
-        } else {
-            m_server->setContentLength(CONTENT_LENGTH_UNKNOWN); // Chunked transfer
-            m_server->sendHeader("Content-Type", "text/html", true);
-            m_server->sendHeader("Cache-Control", "no-cache");
-            m_server->send(200);
-            
-            // Process!
-            static const uint16_t MAX = 2048;
-            String buffer, keyBuffer;
-            buffer.reserve(MAX);
-            int val;
-            char ch;
-
-            while ((val = file.read()) != -1) {
-                ch = char(val);
-                if (ch == '%') {
-                    // Clear out buffer.
-                    m_server->sendContent(buffer);
-                    buffer = "";
-                    buffer.reserve(MAX);
-
-                    // Process substitution.
-                    keyBuffer = "";
-                    bool found(false);
-                    while (!found && (val = file.read()) != -1) {
-                        ch = char(val);
-                        if (ch == '%')
-                            found = true;
-                        else
-                            keyBuffer += ch;
-                    }          
-                    
-                    if (val == -1 && !found) // Check for bad exit.
-                        Logger.log("Cannot process %s: unable to parse", filePath.c_str());
-
-                    // Get substitution
-                    String processed = processTemplates(keyBuffer);
-                    // Logger.log("Lookup '%s' received: %s", keyBuffer.c_str(), processed.c_str());
-                    if (processed.length() < MAX)
-                        buffer = processed;
-                    else
-                        m_server->sendContent(processed);
-                } else {
-                    buffer += ch;
-                    if (buffer.length() >= MAX) {
-                        m_server->sendContent(buffer);
-                        buffer = "";
-                        buffer.reserve(MAX);
-                    }
-                }
+        return;
+    }
+    if (filePath != m_templatePath || file.size() != m_templateSize)
+        compileTemplate(filePath, file);
+    
+    size_t contentLength(0);
+    for (const TemplateSegment& segment : m_templateSegments)
+        contentLength += segment.length + getPlaceholder(segment.placeholder).length();
+    m_server->setContentLength(contentLength);
+    m_server->sendHeader("Cache-Control", "no-cache");
+    m_server->send(200, "text/html", "");
+
+    uint8_t block[TEMPLATE_BLOCK_SIZE];
+    for (const TemplateSegment& segment : m_templateSegments) {
+        file.seek(segment.offset);
+        for (uint32_t sent = 0; sent < segment.length;) {
+            int length = file.read(block, segment.length - sent < sizeof(block) ? segment.length - sent : sizeof(block));
+            if (length <= 0)
+                break;
+            m_server->client().write(block, length);
+            sent += length;
+        }
+        const String& text = getPlaceholder(segment.placeholder);
+        if (text.length() > 0)
+            m_server->client().write(reinterpret_cast<const uint8_t*>(text.c_str()), text.length());
+    }
+    file.close();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDWebserver::sendHistory() {
+    // newest record first, written while the records are read
+    size_t start = m_server->hasArg("start") ? m_server->arg("start").toInt() : 0;
+    size_t count = m_server->hasArg("count") ? m_server->arg("count").toInt() : HISTORY_PAGE_SIZE;
+    if (count > HISTORY_MAX_PAGE_SIZE)
+        count = HISTORY_MAX_PAGE_SIZE;
+    Logger.log("GET /ajax/history (start %u, count %u)", start, count);
+
+    sendJson(nullptr, [=](HSDJsonWriter& json) {
+        const vector<HSDConfig::ColorMapping*>& colorMap = m_config->getColorMap();
+        const vector<HSDConfig::DeviceMapping*>& deviceMap = m_config->getDeviceMap();
+        json.beginObject();
+        json.addNumber("total", m_journal->getSize());
+        json.addNumber("start", start);
+        json.beginArray("records");
+        m_journal->read(start, count, [&](const HSDJournal::Record& record) {
+            json.beginObject();
+            json.addNumber("time", record.time);
+            if (record.flags & HSDJournal::FLAG_UPTIME)
+                json.addBool("uptime", true);
+            json.addString("device", record.device < deviceMap.size() ? deviceMap[record.device]->device.c_str() : "");
+            json.addString("from", record.from < colorMap.size() ? colorMap[record.from]->msg.c_str() : 
+                                   record.from == HSD_JOURNAL_INDEX_NONE ? "" : "other");
+            json.addString("to", record.to < colorMap.size() ? colorMap[record.to]->msg.c_str() : "other");
+            json.endObject();
+        });
+        json.endArray();
+        json.endObject();
+    });
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDWebserver::sendJson(const char* name, JsonContent content) {
+    // chunked response written while the data is serialized, the memory needed does not depend on the table sizes
+    unsigned long start = millis();
+    m_server->setContentLength(CONTENT_LENGTH_UNKNOWN);
+    m_server->send(200, "text/json;charset=utf-8", "");
+    WebServer* server = m_server;
+    HSDJsonWriter json([server](const char* data, size_t length) { server->sendContent_P(data, length); });
+    content(json);
+    json.flush();
+    m_server->sendContent("");
+    if (name)
+        Logger.log("GET %s (%u bytes, %lu ms)", name, (unsigned int)json.getBytes(), millis() - start);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDWebserver::sendLedDevices(uint8_t num) {
+    // device names per LED, only sent once per session and after a configuration change
+    String res;
+    HSDJsonWriter json([&res](const char* data, size_t length) { res.concat(data, length); });
+    json.beginObject();
+    json.addString("method", "ledDevices");
+    json.beginArray("data");
+    for (int ledNr = 0; ledNr < m_config->getNumberOfLeds(); ledNr++)
+        json.addString(nullptr, m_config->getDevice(ledNr));
+    json.endArray();
+    json.endObject();
+    json.flush();
+    if (canSend(num, res.length()) && m_ws->send(num, res)) {
+        m_wsClients[num].devicesSent = true;
+        m_wsClients[num].devicesVersion = m_config->getConfigVersion();
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDWebserver::sendLedFrame(uint8_t num) {
+    WsClient& client = m_wsClients[num];
+    vector<uint8_t> frame;
+    frame.reserve(LED_FRAME_HEADER_SIZE + m_ledFrame.size() * LED_FRAME_ENTRY_SIZE);
+    frame.push_back(client.ledAcked == 0 ? LED_FRAME_FULL : LED_FRAME_DELTA);
+    for (uint8_t shift = 0; shift < 32; shift += 8)
+        frame.push_back(m_ledFrameVersion >> shift);
+    for (uint8_t shift = 0; shift < 32; shift += 8)
+        frame.push_back(client.ledAcked >> shift);
+    frame.push_back(m_ledFrame.size());
+    for (size_t led = 0; led < m_ledFrame.size(); led++) {
+        if (client.ledAcked == 0 || m_ledVersions[led] > client.ledAcked) {
+            frame.push_back(led);
+            frame.push_back(m_ledFrame[led] >> 24);
+            frame.push_back(m_ledFrame[led] >> 16);
+            frame.push_back(m_ledFrame[led] >> 8);
+            frame.push_back(m_ledFrame[led]);
+        }
+    }
+    if (canSend(num, frame.size()) && m_ws->send(num, frame.data(), frame.size(), true))
+        client.ledSent = m_ledFrameVersion;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDWebserver::sendLedUpdates() {
+    // changed LEDs are sent to each client relative to the last frame it acknowledged
+    if (millis() - m_ledSentLast < LED_FRAME_MILLIS || m_ws->connectedClients() == 0 || m_mqtt->isSyncing())
+        return;
+    m_ledSentLast = millis();
+
+    captureLedFrame();
+    for (uint8_t num = 0; num < WEBSOCKETS_SERVER_CLIENT_MAX; num++) {
+        if (!m_ws->clientIsConnected(num))
+            continue;
+        WsClient& client = m_wsClients[num];
+        if (!client.devicesSent || client.devicesVersion != m_config->getConfigVersion())
+            sendLedDevices(num);
+        if (client.ledSent != m_ledFrameVersion)
+            sendLedFrame(num);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDWebserver::sendLogLines() {
+    if (m_logLines.empty())
+        return;
+
+    String payload;
+    uint32_t payloadFirst(m_logFirst + m_logLines.size());
+    uint32_t sentAll(payloadFirst); // lines sent to all clients
+    for (uint8_t num = 0; num < WEBSOCKETS_SERVER_CLIENT_MAX; num++) {
+        if (!m_ws->clientIsConnected(num))
+            continue;
+        WsClient& client = m_wsClients[num];
+        uint32_t end = m_logFirst + m_logLines.size();
+        // a client behind the first kept line skips ahead, the gap is marked in the log
+        uint32_t next = client.logNext < m_logFirst ? m_logFirst : client.logNext;
+        uint32_t dropped = next - client.logNext;
+        size_t count = end - next < WS_LOG_BATCH ? end - next : WS_LOG_BATCH;
+        if (count > 0 || dropped > 0) {
+            if (dropped > 0 || next != payloadFirst) { // clients are usually at the same line
+                payloadFirst = dropped > 0 ? end + 1 : next; // a payload with a marker is not shared
+                DynamicJsonBuffer jsonBuffer;
+                JsonObject& json = jsonBuffer.createObject();
+                json["method"] = "log";
+                JsonArray& linesJson = json.createNestedArray("lines");
+                if (dropped > 0)
+                    linesJson.add(String("... ") + String(dropped) + " log lines dropped ...");
+                for (size_t idx = 0; idx < count; idx++)
+                    linesJson.add(m_logLines[next - m_logFirst + idx]);
+                payload = "";
+                json.printTo(payload);
             }
+            if (canSend(num, payload.length()) && m_ws->send(num, payload))
+                client.logNext = next + count;
+        }
+        if (client.logNext < sentAll)
+            sentAll = client.logNext;
+    }
+    if (sentAll > m_logFirst) {
+        m_logLines.erase(m_logLines.begin(), m_logLines.begin() + (sentAll - m_logFirst));
+        m_logFirst = sentAll;
+    }
+}
 
-            if (val == -1) {
-                if (buffer.length() > 0)
-                    m_server->sendContent(buffer);
-                m_server->sendContent("");
-            }            
-            file.close();
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDWebserver::sendMetrics() {
+    // Prometheus text format, written while it is sent like the JSON responses
+    unsigned long start = millis();
+    m_server->setContentLength(CONTENT_LENGTH_UNKNOWN);
+    m_server->send(200, "text/plain; version=0.0.4; charset=utf-8", "");
+    WebServer* server = m_server;
+    HSDMetricsWriter metrics([server](const char* data, size_t length) { server->sendContent_P(data, length); });
+    writeMetrics(metrics);
+    if (m_metricsCallback)
+        m_metricsCallback(metrics);
+    metrics.flush();
+    m_server->sendContent("");
+    Logger.log("GET /metrics (%u bytes, %lu ms)", (unsigned int)metrics.getBytes(), millis() - start);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDWebserver::sendStatusUpdates() {
+    // changes are coalesced, each client gets the entries changed since the version it has seen
+    if (millis() - m_statusSentLast < STATUS_UPDATE_MILLIS)
+        return;
+    m_statusSentLast = millis();
+
+    String payload;
+    uint32_t payloadSince(m_statusVersion);
+    for (uint8_t num = 0; num < WEBSOCKETS_SERVER_CLIENT_MAX; num++) {
+        WsClient& client = m_wsClients[num];
+        if (!m_ws->clientIsConnected(num) || client.statusVersion == m_statusVersion)
+            continue;
+        if (client.statusVersion != payloadSince) { // clients are usually at the same version
+            payloadSince = client.statusVersion;
+            payload = createUpdateRequest(payloadSince);
         }
+        if (canSend(num, payload.length()) && m_ws->send(num, payload))
+            client.statusVersion = m_statusVersion;
     }
 }
 
@@ -775,3 +1232,217 @@ void HSDWebserver::setUpdaterError() {
     Update.printError(str);
     m_updaterError = str.c_str();
 }
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDWebserver::writeColorMapping(HSDJsonWriter& json) const {
+    const vector<HSDConfig::ColorMapping*>& colMap = m_config->getColorMap();
+    json.beginArray();
+    for (unsigned int index = 0; index < colMap.size(); index++) {
+        const HSDConfig::ColorMapping* mapping = colMap[index];
+        json.beginObject();
+        json.addNumber("id", index);
+        json.addString("msg", mapping->msg);
+        json.addString("col", m_config->hex2string(mapping->color));
+        json.addNumber("beh", static_cast<int>(mapping->behavior));
+        json.endObject();
+    }
+    json.endArray();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDWebserver::writeConfig(HSDJsonWriter& json) const {
+    json.beginObject();
+    json.beginArray("gpios");
+#ifdef ARDUINO_ARCH_ESP32
+    const uint8_t maxGpio = 17;
+    const uint8_t gpios[maxGpio] = {2, 4, 5, 12, 13, 14, 15, 16, 17, 18, 19, 23, 25, 26, 27, 32, 33};
+#else    
+    const uint8_t maxGpio = 11;
+    const uint8_t gpios[maxGpio] = {0, 1, 2, 3, 4, 5, 12, 13, 14, 15, 16};
+#endif    
+    for (uint8_t idx = 0; idx < maxGpio; idx++)
+        json.addNumber(nullptr, gpios[idx]);
+    json.endArray();
+
+    json.beginArray("entries");
+    auto cfgEntries = m_config->cfgEntries();
+    HSDConfig::Group lastGroup = HSDConfig::Group::__Last;
+    for (unsigned int index = 0; index < cfgEntries.size(); index++) {
+        auto entry = cfgEntries[index];
+        if (entry->type == HSDConfig::DataType::ColorMapping || entry->type == HSDConfig::DataType::DeviceMapping)
+            continue;
+
+        if (lastGroup != entry->group) {
+            if (lastGroup != HSDConfig::Group::__Last) {
+                json.endArray();
+                json.endObject();
+            }
+            lastGroup = entry->group;
+            json.beginObject();
+            json.addString("name", m_config->groupDescription(entry->group));
+            json.beginArray("entries");
+        }
+        json.beginObject();
+        json.addString("key", entry->key);
+        json.addString("label", entry->label);
+        if (entry->pattern.length() > 0)
+            json.addString("pattern", entry->pattern);
+        if (entry->patternMsg.length() > 0)
+            json.addString("patternMsg", entry->patternMsg);
+        if (entry->maxVal > 0)
+            json.addNumber("maxVal", entry->maxVal);
+        json.addNumber("type", static_cast<int>(entry->type));
+        switch (entry->type) {
+            case HSDConfig::DataType::String:
+            case HSDConfig::DataType::Password:
+                json.addString("value", *entry->value.string);
+                break;
+                
+            case HSDConfig::DataType::Bool:
+                json.addBool("value", *entry->value.boolean);
+                break;
+                
+            case HSDConfig::DataType::Gpio:
+            case HSDConfig::DataType::Slider:
+                json.addNumber("value", *entry->value.byte);
+                break;
+                
+            case HSDConfig::DataType::Word:
+                json.addNumber("value", *entry->value.word);
+                break;
+
+            case HSDConfig::DataType::ColorMapping:
+            case HSDConfig::DataType::DeviceMapping:
+                break;
+        }
+        json.endObject();
+    }
+    if (lastGroup != HSDConfig::Group::__Last) {
+        json.endArray();
+        json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDWebserver::writeDeviceMapping(HSDJsonWriter& json) const {
+    const vector<HSDConfig::DeviceMapping*>& devMap = m_config->getDeviceMap();
+    json.beginArray();
+    for (unsigned int index = 0; index < devMap.size(); index++) {
+        const HSDConfig::DeviceMapping* mapping = devMap[index];
+        json.beginObject();
+        json.addNumber("id", index);
+        json.addString("device", mapping->device);
+        json.addNumber("led", mapping->ledNumber);
+        json.addString("path", mapping->path);
+        json.addNumber("debounce", mapping->debounce);
+        json.endObject();
+    }
+    json.endArray();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDWebserver::writeStatus(HSDJsonWriter& json) const {
+    json.beginObject();
+    json.beginArray("table");
+    StatusClass type = StatusClass::__Last;
+    for (unsigned int index = 0; index < m_statusEntries.size(); index++) {
+        const StatusEntry* entry = m_statusEntries[index];
+        if (entry->type != type) {
+            if (type != StatusClass::__Last) {
+                json.endArray();
+                json.endObject();
+            }
+            type = entry->type;
+            json.beginObject();
+            json.addString("name", getTypeName(entry->type));
+            json.beginArray("entries");
+        }
+        json.beginObject();
+        json.addString("label", entry->label);
+        json.addString("value", entry->value);
+        if (entry->unit.length() > 0)
+            json.addString("unit", entry->unit);
+        if (entry->id.length() > 0)
+            json.addString("id", entry->id);
+        json.endObject();
+    }
+    if (type != StatusClass::__Last) {
+        json.endArray();
+        json.endObject();
+    }
+    json.endArray();
+
+    json.beginArray("leds");
+    uint8_t idx(0);
+    for (int ledNr = 0; ledNr < m_config->getNumberOfLeds(); ledNr++) {
+        uint32_t color = m_leds->getColor(ledNr);
+        HSDConfig::Behavior behavior = m_leds->getBehavior(ledNr);
+        if ((LED_COLOR_NONE != color) && (HSDConfig::Behavior::Off != behavior)) {
+            json.beginObject();
+            json.addNumber("id", idx++);
+            json.addNumber("led", ledNr);
+            json.addString("device", m_config->getDevice(ledNr));
+            json.addString("col", m_config->hex2string(color));
+            json.addNumber("beh", static_cast<int>(behavior));
+            json.endObject();
+        }
+    }
+    json.endArray();
+    json.endObject();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HSDWebserver::writeMetrics(HSDMetricsWriter& metrics) const {
+    metrics.addGauge("hsd_uptime_seconds", "Time since start", 
+                     m_uptimeMinutes * 60.0 + (millis() - m_uptimeMillis) / 1000);
+    metrics.addGauge("hsd_heap_free_bytes", "Free heap", ESP.getFreeHeap());
+#ifdef ESP32
+    uint32_t maxBlock = ESP.getMaxAllocHeap();
+    metrics.addGauge("hsd_heap_min_free_bytes", "Lowest free heap since start", ESP.getMinFreeHeap());
+#elif defined(ESP8266)
+    uint32_t maxBlock = ESP.getMaxFreeBlockSize();
+    metrics.addGauge("hsd_voltage_millivolts", "Supply voltage", ESP.getVcc());
+#endif
+    metrics.addGauge("hsd_heap_max_block_bytes", "Largest free heap block", maxBlock);
+#ifdef ESP32
+    uint32_t freeHeap = ESP.getFreeHeap();
+    metrics.addGauge("hsd_heap_fragmentation_percent", "Heap fragmentation", 
+                     freeHeap > 0 ? 100 - maxBlock * 100.0 / freeHeap : 0);
+#elif defined(ESP8266)
+    metrics.addGauge("hsd_heap_fragmentation_percent", "Heap fragmentation", ESP.getHeapFragmentation());
+#endif
+    if (WiFi.isConnected())
+        metrics.addGauge("hsd_wifi_rssi_dbm", "WiFi signal strength", WiFi.RSSI());
+
+    metrics.addGauge("hsd_mqtt_connected", "1 if connected to the MQTT broker", m_mqtt->connected() ? 1 : 0);
+    metrics.addCounter("hsd_mqtt_connect_attempts_total", "MQTT connect attempts", m_mqtt->getConnectAttempts());
+    metrics.addCounter("hsd_mqtt_connects_total", "MQTT sessions established", m_mqtt->getConnects());
+    metrics.addCounter("hsd_mqtt_messages_received_total", "MQTT messages received", 
+                       m_mqtt->getMessages() + m_mqtt->getStreamMessages());
+    metrics.addCounter("hsd_mqtt_messages_skipped_total", "MQTT messages over the payload limit", 
+                       m_mqtt->getStreamSkipped());
+    metrics.addCounter("hsd_mqtt_messages_published_total", "MQTT messages published", m_mqtt->getPublished());
+    const HSDMqttQueue& queue = m_mqtt->getQueue();
+    metrics.addGauge("hsd_mqtt_queue_depth", "Messages waiting for the MQTT broker", queue.getDepth());
+    metrics.addCounter("hsd_mqtt_queue_dropped_total", "Messages dropped from the full MQTT queue", queue.getDrops());
+
+    metrics.addCounter("hsd_led_frames_total", "Status frames shown on the LED stripe", m_leds->getFrames());
+    const HSDLeds::StreamStats& stream = m_leds->getStreamStats();
+    metrics.addCounter("hsd_led_stream_frames_total", "DDP frames shown", stream.frames);
+    metrics.addCounter("hsd_led_stream_dropped_total", "DDP packets missing", stream.dropped);
+    metrics.addCounter("hsd_led_stream_malformed_total", "DDP packets malformed", stream.malformed);
+
+    metrics.addGauge("hsd_websocket_clients", "Connected WebSocket clients", m_ws->connectedClients());
+    metrics.addCounter("hsd_websocket_evictions_total", "WebSocket clients disconnected because they fell behind", 
+                       m_wsEvictions);
+    metrics.addGauge("hsd_http_transfers", "Files being sent", m_fileSender.getActive());
+    metrics.addCounter("hsd_http_transfers_completed_total", "Files sent", m_fileSender.getCompleted());
+    metrics.addCounter("hsd_http_transfers_aborted_total", "File transfers aborted", m_fileSender.getAborted());
+}
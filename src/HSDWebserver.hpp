@@ -9,12 +9,18 @@
 #include <FS.h>
 #define WebServer ESP8266WebServer
 #endif
-#include <WebSocketsServer.h>
 #include <vector>
 
 #include "HSDConfig.hpp"
+#include "HSDFileSender.hpp"
+#include "HSDJournal.hpp"
+#include "HSDJsonScanner.hpp"
+#include "HSDJsonWriter.hpp"
 #include "HSDLeds.hpp"
+#include "HSDMetricsWriter.hpp"
 #include "HSDMqtt.hpp"
+#include "HSDPerfectHash.hpp"
+#include "HSDWebSocketsServer.hpp"
 
 using namespace std;
 
@@ -33,50 +39,147 @@ public:
     };
     
     struct StatusEntry {
-        StatusEntry(StatusClass c, const char* l, const String& v, const char* u = "", const char* id = "") : id(id), label(l), type(c), unit(u), value(v) {}
+        StatusEntry(StatusClass c, const char* l, const String& v, const char* u = "", const char* id = "") : id(id), label(l), type(c), unit(u), value(v), version(0) {}
         
         const String id;
         const String label;
         StatusClass  type;
         const String unit;
         String       value;
+        uint32_t     version; // status version of the last change
     };
 
-    HSDWebserver(HSDConfig* config, const HSDLeds* leds, const HSDMqtt* mqtt);
+    // writes the metrics of the modules the web server does not know
+    typedef std::function<void(HSDMetricsWriter& metrics)> MetricsCallback;
+    // applies a bulk status payload, returns false if it contained malformed entries
+    typedef std::function<bool(const char* payload, size_t length, unsigned int& entries, unsigned int& updates)> StatusCallback;
+
+    HSDWebserver(HSDConfig* config, const HSDLeds* leds, const HSDMqtt* mqtt, const HSDJournal* journal);
 
     void        begin();
-    void        ledChange();
     bool        log(vector<String> lines);
-    inline void handle() { m_server->handleClient(); m_ws->loop(); }
+    void        handle();
+    inline void onMetrics(MetricsCallback callback) { m_metricsCallback = callback; }
+    inline void onStatus(StatusCallback callback) { m_statusCallback = callback; }
     inline void registerStatusEntry(StatusClass type, const char* label, const String& value, const char* unit = "", const char* id = "") { m_statusEntries.push_back(new StatusEntry(type, label, value, unit, id)); }
     void        setUptime(unsigned long& deviceUptime);
     void        updateStatusEntry(const String& id, const String& value);
 
 private:
-    void   createLedArray(JsonArray& leds) const;
-    String createUpdateRequest() const;
+    enum class Placeholder : uint8_t {
+        None = 0,
+        Config,
+        Version
+    };
+
+    typedef std::function<void(HSDJsonWriter& json)> JsonContent;
+
+    struct StaticFile {
+        String   path;        // request path, without .gz
+        String   contentType;
+        String   etag;        // size and FNV-1a hash of the content
+        uint32_t size;
+        bool     gzip;        // stored as <path>.gz
+    };
+
+    struct WsClient {
+        WsClient() : devicesSent(false), devicesVersion(0), ledAcked(0), ledSent(0), logNext(0), maxDepth(0), 
+                     statusVersion(0), writableLast(0) {}
+
+        String        buffer;         // received text fragments
+        bool          devicesSent;    // LED device names sent for devicesVersion
+        uint32_t      devicesVersion; // config version
+        uint32_t      ledAcked;       // LED frame version acknowledged by the client, 0 = send a full frame
+        uint32_t      ledSent;        // LED frame version sent last
+        uint32_t      logNext;        // number of the next log line to send
+        size_t        maxDepth;       // largest queue depth since the last report
+        uint32_t      statusVersion;  // status version sent, 0 = send all entries
+        unsigned long writableLast;   // last time the client could take a message or had nothing queued
+    };
+
+    struct TemplateSegment {
+        uint32_t    offset;      // literal text in the template file
+        uint32_t    length;
+        Placeholder placeholder; // replaced text following the literal text
+    };
+
+    void   buildFileIndex();
+    void   buildStatusIndex();
+    bool   canSend(uint8_t num, size_t length);
+    void   captureLedFrame();
+    void   checkWsClients();
+    void   compileTemplate(const String& filePath, File& file);
+    String createUpdateRequest(uint32_t since) const;
     void   deliverNotFoundPage();
+    void   editTable(const String& table, const JsonArray& ops) const;
+    const StaticFile* findStaticFile(const String& path) const;
+    size_t getQueueDepth(uint8_t num) const;
     String getConfig() const;
+    const String& getPlaceholder(Placeholder placeholder);
     String getTypeName(StatusClass type) const;
     String getUptimeString(unsigned long& uptime) const;
+    void   handleConfigUpload();
     bool   handleFileRead(String path);
     void   handleWebSocket(uint8_t num, WStype_t type, uint8_t * payload, size_t length);
-    void   importConfig(const String& filename, const String& content) const;
-    String processTemplates(const String& key) const;
+    HSDConfig::ColorMapping parseColorMapping(const JsonObject& elem) const;
+    HSDConfig::DeviceMapping parseDeviceMapping(const JsonObject& elem) const;
     void   saveColorMapping(const JsonArray& colMapping) const;
     void   saveConfig(const JsonObject& config) const;
     void   saveDeviceMapping(const JsonArray& devMapping) const;
     void   sendAndProcessTemplate(const String& filePath);
+    void   sendHistory();
+    void   sendJson(const char* name, JsonContent content);
+    void   sendLedDevices(uint8_t num);
+    void   sendLedFrame(uint8_t num);
+    void   sendLedUpdates();
+    void   sendLogLines();
+    void   sendMetrics();
+    void   sendStatusUpdates();
     void   setUpdaterError();
+    void   writeColorMapping(HSDJsonWriter& json) const;
+    void   writeConfig(HSDJsonWriter& json) const;
+    void   writeDeviceMapping(HSDJsonWriter& json) const;
+    void   writeMetrics(HSDMetricsWriter& metrics) const;
+    void   writeStatus(HSDJsonWriter& json) const;
 
     HSDConfig*           m_config;
+    String               m_configHtml;        // rendered %CONFIG% placeholder
+    uint32_t             m_configHtmlVersion; // config version m_configHtml was rendered for
+    HSDFileSender        m_fileSender;
+    bool                 m_importComplete;    // the uploaded config file is valid
+    String               m_importError;
+    File                 m_importFile;
+    uint8_t              m_importGroups;      // known configuration groups in the uploaded file
+    HSDJsonScanner*      m_importScanner;     // only exists while a config file is uploaded
+    const HSDJournal*    m_journal;
+    vector<uint32_t>     m_ledFrame;          // color (RGB) and behavior per LED, as sent to the clients
+    uint32_t             m_ledFrameVersion;   // incremented with every changed frame
+    unsigned long        m_ledSentLast;
+    uint32_t             m_ledStateVersion;   // LED state version m_ledFrame was captured for, 0 after a stream
+    vector<uint32_t>     m_ledVersions;       // frame version of the last change per LED
+    uint32_t             m_logFirst;          // number of the first line in m_logLines
+    vector<String>       m_logLines;          // log lines not yet sent to all websocket clients
     const HSDLeds*       m_leds;
+    MetricsCallback      m_metricsCallback;
     const HSDMqtt*       m_mqtt;
     WebServer*           m_server;
+    vector<StaticFile>   m_staticFiles;       // files of the data directory, indexed at start
+    StatusCallback       m_statusCallback;
     vector<StatusEntry*> m_statusEntries;
+    HSDPerfectHash       m_statusIndex;
+    vector<StatusEntry*> m_statusIndexEntries; // entries with an id, in the order of the index keys
+    size_t               m_statusIndexSize;    // number of status entries the index was built for
+    unsigned long        m_statusSentLast;
+    uint32_t             m_statusVersion;      // incremented with every changed status entry
+    String               m_templatePath;
+    vector<TemplateSegment> m_templateSegments;
+    size_t               m_templateSize;      // size of the template file when it was compiled
     String               m_updaterError;
-    WebSocketsServer*    m_ws;
-    String               m_wsBuffer[WEBSOCKETS_SERVER_CLIENT_MAX];
+    unsigned long        m_uptimeMillis;      // time of the last setUptime()
+    unsigned long        m_uptimeMinutes;
+    HSDWebSocketsServer* m_ws;
+    WsClient             m_wsClients[WEBSOCKETS_SERVER_CLIENT_MAX];
+    uint32_t             m_wsEvictions;       // clients disconnected because they fell behind
 };
 
 #endif // HSDWEBSERVER_H
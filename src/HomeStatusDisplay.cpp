@@ -5,6 +5,7 @@
 #include <ArduinoOTA.h>
 
 #define ONE_MINUTE_MILLIS (60000)
+#define LED_MIRROR_MILLIS (1000) // LED states are published at most once within this time
 
 // for placeholders 
 using namespace std::placeholders; 
@@ -15,18 +16,33 @@ HomeStatusDisplay::HomeStatusDisplay() :
 #if defined HSD_BLUETOOTH_ENABLED && defined ARDUINO_ARCH_ESP32
     m_bluetooth(nullptr),
 #endif    
+    m_bulkParser(nullptr),
+    m_bulkBytes(0),
+    m_bulkEntries(0),
+    m_bulkSource(Source::Mqtt),
+    m_bulkUpdates(0),
 #ifdef HSD_CLOCK_ENABLED
     m_clock(nullptr),
 #endif
     m_config(new HSDConfig()),
+    m_deviceTablesVersion(0),
+    m_journalColorsVersion(0),
+    m_jsonPath(nullptr),
+    m_ledMirrorLast(0),
+    m_ledMirrorVersion(0),
     m_leds(new HSDLeds(m_config)),
+    m_loopCount(0),
+    m_loopMaxMicros(0),
+    m_loopMicros(0),
     m_mqttHandler(new HSDMqtt(m_config, std::bind(&HomeStatusDisplay::mqttCallback, this, _1, _2, _3))),
 #ifdef HSD_SENSOR_ENABLED
     m_sensor(nullptr),
 #endif
-    m_webServer(new HSDWebserver(m_config, m_leds, m_mqttHandler)),
+    m_udp(nullptr),
+    m_webServer(new HSDWebserver(m_config, m_leds, m_mqttHandler, &m_journal)),
     m_wifi(new HSDWifi(m_config, m_leds, m_webServer))
 {
+    memset(m_sourceMessages, 0, sizeof(m_sourceMessages));
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
@@ -38,6 +54,7 @@ void HomeStatusDisplay::begin() {
 
     Logger.setWebServer(m_webServer);
     m_config->begin();
+    m_journal.begin();
     ArduinoOTA.setHostname(m_config->getHost().c_str());
     ArduinoOTA.onStart([=]() {
         String type;
@@ -77,11 +94,33 @@ void HomeStatusDisplay::begin() {
             reason = "End Failed";
         Logger.log("ArduinoOTA: error[%u]: %s", error, reason);
         m_leds->clear();
+        m_rules.invalidate();
+        m_mqttHandler->resubscribe(); // the retained statuses show the LEDs again
     });    
     m_leds->begin();
     m_wifi->begin();
+    m_webServer->onStatus([=](const char* payload, size_t length, unsigned int& entries, unsigned int& updates) {
+        bool success = handleBulkStatus(payload, length, Source::Http);
+        entries = m_bulkEntries;
+        updates = m_bulkUpdates;
+        return success;
+    });
+    m_webServer->onMetrics([=](HSDMetricsWriter& metrics) { writeMetrics(metrics); });
     m_webServer->begin();
+    if (m_config->getStatusUdpPort() > 0) {
+        m_udp = new WiFiUDP();
+        if (m_udp->begin(m_config->getStatusUdpPort())) {
+            Logger.log("Listening for status datagrams on UDP port %u", m_config->getStatusUdpPort());
+        } else {
+            Logger.log("Failed to open UDP port %u", m_config->getStatusUdpPort());
+            delete m_udp;
+            m_udp = nullptr;
+        }
+    }
     m_mqttHandler->begin();
+    m_mqttHandler->setStreamCallbacks(std::bind(&HomeStatusDisplay::beginStream, this, _1, _2), 
+                                      std::bind(&HomeStatusDisplay::feedStream, this, _1, _2),
+                                      std::bind(&HomeStatusDisplay::endStream, this, _1));
 #ifdef HSD_CLOCK_ENABLED
     if (m_config->getClockEnabled()) {
         m_clock = new HSDClock(m_config);
@@ -106,17 +145,26 @@ void HomeStatusDisplay::begin() {
 // ---------------------------------------------------------------------------------------------------------------------
 
 void HomeStatusDisplay::work() {
+    unsigned long start = micros();
     checkMqttConnections();
+    checkDebounce();
+    checkRules();
+    m_config->handle();
+    if (m_journal.isRemapPending() && !m_config->isWritePending())
+        m_journal.remapFiles(); // together with the deferred write of the table edits
+    m_journal.handle();
     m_wifi->handleConnection();
     calcUptime();
     m_webServer->handle();
 
     if (WiFi.isConnected()) {
         m_mqttHandler->handle();
+        checkUdp();
         ArduinoOTA.handle();
     }
   
     m_leds->update();
+    checkLedMirror();
 #ifdef HSD_CLOCK_ENABLED
     if (m_clock)
         m_clock->handle();
@@ -129,6 +177,13 @@ void HomeStatusDisplay::work() {
     if (m_sensor)
         m_sensor->handle(m_webServer, m_mqttHandler);
 #endif // HSD_SENSOR_ENABLED
+
+    // the longest loop delays MQTT handling and LED animation the most
+    unsigned long duration = micros() - start;
+    m_loopCount++;
+    m_loopMicros += duration;
+    if (duration > m_loopMaxMicros)
+        m_loopMaxMicros = duration;
     delay(1);
 }
 
@@ -141,25 +196,63 @@ void HomeStatusDisplay::calcUptime() {
     if (millis() - oneMinuteTimerLast >= ONE_MINUTE_MILLIS) {
         uptime++;
         oneMinuteTimerLast = millis();
+        const HSDMqttQueue& queue = m_mqttHandler->getQueue();
+        char buffer[64];
+        snprintf(buffer, 64, "%u (max %u), %u dropped, drained in %lu ms", queue.getDepth(), queue.getMaxDepth(), 
+                 queue.getDrops(), m_mqttHandler->getQueueDrainDuration());
+        m_webServer->updateStatusEntry("mqttQueue", buffer);
+        snprintf(buffer, 64, "%u received, %u skipped (limit %u bytes)", m_mqttHandler->getStreamMessages(), 
+                 m_mqttHandler->getStreamSkipped(), m_config->getMqttMaxPayload());
+        m_webServer->updateStatusEntry("mqttLarge", buffer);
+        static unsigned long lastSourceMessages[static_cast<int>(Source::__Last)] = { 0 };
+        unsigned long rates[static_cast<int>(Source::__Last)];
+        for (int idx = 0; idx < static_cast<int>(Source::__Last); idx++) {
+            rates[idx] = m_sourceMessages[idx] - lastSourceMessages[idx];
+            lastSourceMessages[idx] = m_sourceMessages[idx];
+        }
+        snprintf(buffer, 64, "MQTT %lu, HTTP %lu, UDP %lu", rates[static_cast<int>(Source::Mqtt)], 
+                 rates[static_cast<int>(Source::Http)], rates[static_cast<int>(Source::Udp)]);
+        m_webServer->updateStatusEntry("statusRates", buffer);
+        snprintf(buffer, 64, "%u records (%u in RAM), %u writes, %u dropped", m_journal.getSize(), 
+                 m_journal.getPending(), static_cast<unsigned int>(m_journal.getFlushes()), 
+                 static_cast<unsigned int>(m_journal.getDrops()));
+        m_webServer->updateStatusEntry("journal", buffer);
+        snprintf(buffer, 64, "%lu loops, average %lu us, max %lu ms", m_loopCount, 
+                 m_loopCount > 0 ? m_loopMicros / m_loopCount : 0, m_loopMaxMicros / 1000);
+        m_webServer->updateStatusEntry("loop", buffer);
+        m_loopCount = 0;
+        m_loopMaxMicros = 0;
+        m_loopMicros = 0;
+        if (m_rules.getRuleCount() > 0 || m_rules.getErrors() > 0) {
+            snprintf(buffer, 64, "%u rules, %u errors, %u evaluations (%u us)", m_rules.getRuleCount(), 
+                     m_rules.getErrors(), static_cast<unsigned int>(m_rules.getEvaluations()), 
+                     static_cast<unsigned int>(m_rules.getEvaluationMicros()));
+            m_webServer->updateStatusEntry("rules", buffer);
+        }
+        if (m_config->getLedStreamPort() > 0) {
+            const HSDLeds::StreamStats& stream = m_leds->getStreamStats();
+            snprintf(buffer, 64, "%s, %u fps, %u frames, %u dropped, %u malformed", 
+                     m_leds->isStreaming() ? "active" : "idle", stream.fps, static_cast<unsigned int>(stream.frames), 
+                     static_cast<unsigned int>(stream.dropped), static_cast<unsigned int>(stream.malformed));
+            m_webServer->updateStatusEntry("ledStream", buffer);
+        }
         m_webServer->setUptime(uptime);
-        if (m_mqttHandler->connected()) {
-            String topic = m_config->getMqttOutTopic("statistic");
-            if (m_mqttHandler->isTopicValid(topic)) {
-                DynamicJsonBuffer jsonBuffer;
-                JsonObject& json = jsonBuffer.createObject();
-                json["Uptime"] = uptime;
-                json["HeapFree"] = ESP.getFreeHeap();
+        String topic = m_config->getMqttOutTopic("statistic");
+        if (m_mqttHandler->isTopicValid(topic)) {
+            DynamicJsonBuffer jsonBuffer;
+            JsonObject& json = jsonBuffer.createObject();
+            json["Uptime"] = uptime;
+            json["HeapFree"] = ESP.getFreeHeap();
 #ifdef ESP32
-                json["HeapMinFree"] = ESP.getMinFreeHeap();
-                json["HeapSize"] = ESP.getHeapSize();
+            json["HeapMinFree"] = ESP.getMinFreeHeap();
+            json["HeapSize"] = ESP.getHeapSize();
 #elif defined(ESP8266)
-                json["HeapMax"] = ESP.getMaxFreeBlockSize();
-                json["HeapFrag"] = ESP.getHeapFragmentation();
+            json["HeapMax"] = ESP.getMaxFreeBlockSize();
+            json["HeapFrag"] = ESP.getHeapFragmentation();
 #endif
-                if (WiFi.isConnected())
-                    json["RSSI"] = WiFi.RSSI();
-                m_mqttHandler->publish(topic, json);
-            }
+            if (WiFi.isConnected())
+                json["RSSI"] = WiFi.RSSI();
+            m_mqttHandler->publish(topic, json, true);
         }
     }
 }
@@ -168,38 +261,55 @@ void HomeStatusDisplay::calcUptime() {
 
 void HomeStatusDisplay::mqttCallback(char* topic, byte* payload, unsigned int length) {
     String mqttTopicString(topic);
+    String device;
+    bool isStatus = getDevice(mqttTopicString, device);
+    if (isStatus && isBulkDevice(device)) {
+        handleBulkStatus(reinterpret_cast<const char*>(payload), length, Source::Mqtt);
+        return;
+    }
+    if (isStatus)
+        m_sourceMessages[static_cast<int>(Source::Mqtt)]++;
+
+    bool syncing = m_mqttHandler->isSyncing(); // LEDs and web interface are updated once the sync has finished
+    if (isStatus) {
+        String path = m_config->getDevicePath(device);
+        if (path.length() > 0) {
+            if (!syncing)
+                Logger.log("Received an MQTT message for topic %s (%u bytes)", topic, length);
+            handlePathStatus(device, path, reinterpret_cast<const char*>(payload), length, !syncing);
+            return;
+        }
+    }
+
     String mqttMsgString;
 
     for (unsigned int idx = 0; idx < length; idx++)
         mqttMsgString += (char)payload[idx];
   
-    Logger.log("Received an MQTT message for topic %s: %s", topic, mqttMsgString.c_str());
+    if (!syncing)
+        Logger.log("Received an MQTT message for topic %s: %s", topic, mqttMsgString.c_str());
 
-    if (isStatusTopic(mqttTopicString)) {
-        if (handleStatus(getDevice(mqttTopicString), mqttMsgString))
-            m_webServer->ledChange();
+    if (isStatus) {
+        handleStatus(device, mqttMsgString, !syncing);
     }
 #ifdef MQTT_TEST_TOPIC    
     else if (mqttTopicString.equals(m_config->getMqttTestTopic())) {
         handleTest(mqttMsgString);
-        m_webServer->ledChange();
     }
 #endif // MQTT_TEST_TOPIC    
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
 
-bool HomeStatusDisplay::isStatusTopic(const String& topic) const {
-    String mqttStatusTopic = m_config->getMqttStatusTopic();
-    int posOfLastSlashInStatusTopic = mqttStatusTopic.lastIndexOf("/");
-    return topic.startsWith(mqttStatusTopic.substring(0, posOfLastSlashInStatusTopic));
+bool HomeStatusDisplay::isBulkDevice(const String& device) const {
+    const String& bulkDevice = m_config->getMqttBulkDevice();
+    return bulkDevice.length() > 0 && device.equals(bulkDevice);
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
 
-String HomeStatusDisplay::getDevice(const String& statusTopic) const {
-    int posOfLastSlashInStatusTopic = statusTopic.lastIndexOf("/");
-    return statusTopic.substring(posOfLastSlashInStatusTopic + 1);
+bool HomeStatusDisplay::getDevice(const String& topic, String& device) const {
+    return m_mqttHandler->matchStatusTopic(topic.c_str(), device) >= 0;
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
@@ -211,48 +321,374 @@ void HomeStatusDisplay::handleTest(const String& msg) {
         m_leds->test(type);
     } else if (type == 0) {
         m_leds->clear();
+        m_rules.invalidate();
         m_mqttHandler->reconnect();  // back to normal
+        m_mqttHandler->resubscribe(); // with the retained statuses, even if the session is resumed
     }
 }
 #endif // MQTT_TEST_TOPIC
 // ---------------------------------------------------------------------------------------------------------------------
 
-bool HomeStatusDisplay::handleStatus(const String& device, const String& msg) { 
-    bool update(false);
-    int ledNumber(m_config->getLedNumber(device));
-    if (ledNumber != -1) {
-        int colorMapIndex(m_config->getColorMapIndex(msg));    
-        if (colorMapIndex != -1) {
-            auto behavior = m_config->getLedBehavior(colorMapIndex);
-            uint32_t color = m_config->getLedColor(colorMapIndex);
+uint32_t HomeStatusDisplay::getTime(bool& uptime) const {
+#ifdef HSD_CLOCK_ENABLED
+    if (ezt::timeStatus() == timeSet) {
+        uptime = false;
+        return UTC.now();
+    }
+#endif
+    uptime = true;
+    return millis() / 1000;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HomeStatusDisplay::handleBulkStatus(const char* payload, unsigned int length, Source source) {
+    beginBulkStatus(source);
+    feedBulkStatus(payload, length);
+    return endBulkStatus(true);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HomeStatusDisplay::beginBulkStatus(Source source) {
+    delete m_bulkParser;
+    m_bulkBytes = m_bulkEntries = m_bulkUpdates = 0;
+    m_bulkSource = source;
+    m_bulkParser = new HSDBulkParser([=](const char* device, const char* msg) {
+        m_bulkEntries++;
+        if (handleStatus(device, msg, false))
+            m_bulkUpdates++;
+    });
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HomeStatusDisplay::feedBulkStatus(const char* data, size_t length) {
+    if (m_bulkParser) {
+        m_bulkParser->feed(data, length);
+        m_bulkBytes += length;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HomeStatusDisplay::endBulkStatus(bool complete) {
+    if (!m_bulkParser)
+        return false;
+    
+    bool success = m_bulkParser->finish() && complete;
+    if (!success && complete)
+        Logger.log("Bulk status: %u malformed entries ignored", m_bulkParser->getErrors());
+    if (!complete)
+        Logger.log("Bulk status: connection lost after %u bytes", m_bulkBytes);
+    Logger.log("Bulk status: %u entries (%u bytes) applied, %u LEDs changed", m_bulkEntries, m_bulkBytes, m_bulkUpdates);
+    delete m_bulkParser;
+    m_bulkParser = nullptr;
+    m_sourceMessages[static_cast<int>(m_bulkSource)] += m_bulkEntries;
+    return success;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HomeStatusDisplay::checkUdp() {
+    if (!m_udp)
+        return;
+    
+    // every datagram is a bulk status, read in small blocks instead of buffering the whole datagram
+    int size = m_udp->parsePacket();
+    if (size > 0) {
+        Logger.log("Received a status datagram from %s (%d bytes)", m_udp->remoteIP().toString().c_str(), size);
+        char buffer[64];
+        beginBulkStatus(Source::Udp);
+        int length;
+        while ((length = m_udp->read(buffer, sizeof(buffer))) > 0)
+            feedBulkStatus(buffer, length);
+        endBulkStatus(true);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HomeStatusDisplay::beginStream(const char* topic, uint32_t length) {
+    if (!getDevice(topic, m_jsonPathDevice))
+        return false;
+    if (isBulkDevice(m_jsonPathDevice)) {
+        beginBulkStatus(Source::Mqtt);
+        return true;
+    }
+    
+    // large device messages only make sense if a value is extracted
+    m_jsonPathPath = m_config->getDevicePath(m_jsonPathDevice);
+    if (m_jsonPathPath.length() == 0)
+        return false;
+    delete m_jsonPath;
+    m_jsonPath = new HSDJsonPath(m_jsonPathPath.c_str());
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HomeStatusDisplay::feedStream(const uint8_t* data, size_t length) {
+    if (m_jsonPath)
+        m_jsonPath->feed(reinterpret_cast<const char*>(data), length);
+    else
+        feedBulkStatus(reinterpret_cast<const char*>(data), length);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HomeStatusDisplay::endStream(bool complete) {
+    if (!m_jsonPath) {
+        endBulkStatus(complete);
+        return;
+    }
+    
+    m_sourceMessages[static_cast<int>(Source::Mqtt)]++;
+    bool syncing = m_mqttHandler->isSyncing();
+    if (complete && m_jsonPath->isFound()) {
+        handleStatus(m_jsonPathDevice, m_jsonPath->getValue(), !syncing);
+    } else if (!syncing) {
+        Logger.log("No value for path %s in message for device %s, ignoring it", m_jsonPathPath.c_str(), 
+                   m_jsonPathDevice.c_str());
+    }
+    delete m_jsonPath;
+    m_jsonPath = nullptr;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HomeStatusDisplay::handlePathStatus(const String& device, const String& path, const char* payload, 
+                                         unsigned int length, bool verbose) {
+    HSDJsonPath jsonPath(path.c_str());
+    jsonPath.feed(payload, length);
+    if (!jsonPath.isFound()) {
+        if (verbose)
+            Logger.log("No value for path %s in message for device %s, ignoring it", path.c_str(), device.c_str());
+        return false;
+    }
+    return handleStatus(device, jsonPath.getValue(), verbose);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HomeStatusDisplay::handleStatus(const String& device, const String& msg, bool verbose) { 
+    m_rules.update(device, msg);
+    int deviceIndex(m_config->getDeviceIndex(device));
+    if (deviceIndex == -1) {
+        if (verbose)
+            Logger.log("No LED defined for device %s, ignoring it", device.c_str());
+        return false;
+    }
+    
+    const HSDConfig::DeviceMapping* mapping = m_config->getDeviceMap()[deviceIndex];
+    int ledNumber(mapping->ledNumber);
+    HSDConfig::Behavior behavior;
+    uint32_t color;
+    int colorMapIndex;
+    bool isKnown = resolveStatus(msg, behavior, color, &colorMapIndex);
+    
+    updateDeviceTables();
+    // only statuses which are shown are journaled, held back ones when they are released by checkDebounce()
+    uint8_t journalIndex = colorMapIndex >= 0 && colorMapIndex < HSD_JOURNAL_INDEX_OTHER ? colorMapIndex : 
+                           HSD_JOURNAL_INDEX_OTHER;
+    if (m_mqttHandler->isSyncing()) { // retained statuses are a snapshot, nothing to debounce
+        m_debouncer.force(deviceIndex, behavior, color, journalIndex, millis());
+    } else {
+        switch (m_debouncer.update(deviceIndex, mapping->debounce, behavior, color, journalIndex, millis())) {
+            case HSDDebouncer::Result::Apply:
+                break;
+            case HSDDebouncer::Result::Hold:
+                if (m_debouncer.isFlapping(deviceIndex)) // the flicker follows the latest status
+                    return m_leds->set(ledNumber, HSDConfig::Behavior::Flickering, color);
+                return false;
+            case HSDDebouncer::Result::StartFlapping:
+                Logger.log("Device %s is flapping, holding back its status", device.c_str());
+                recordStatus(deviceIndex, journalIndex);
+                return m_leds->set(ledNumber, HSDConfig::Behavior::Flickering, color);
+        }
+    }
+    recordStatus(deviceIndex, journalIndex);
+    
+    if (verbose) {
+        if (isKnown)
             Logger.log("Set LED number %d to behaviour %u with color #%06X", ledNumber, static_cast<uint8_t>(behavior), color);
-            update = m_leds->set(ledNumber, behavior, color);
-        } else if (msg.length() > 3 && msg[0] == '#') {  // allow MQTT broker to directly set LED color with HEX strings
-            uint32_t color = m_config->string2hex(msg);
-            Logger.log("Received HEX %s and set led number %d with this color ON", msg.c_str(), ledNumber);
-            update = m_leds->set(ledNumber, HSDConfig::Behavior::On, color);
-        } else {
+        else
             Logger.log("Unknown message %s for led number %d, set to OFF", msg.c_str(), ledNumber);
-            update = m_leds->set(ledNumber, HSDConfig::Behavior::Off, LED_COLOR_NONE);
-        }
+    }
+    return m_leds->set(ledNumber, behavior, color);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HomeStatusDisplay::recordStatus(size_t device, uint8_t colorIndex) {
+    bool uptime;
+    uint32_t time = getTime(uptime);
+    m_journal.record(device, colorIndex, time, uptime);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool HomeStatusDisplay::resolveStatus(const String& msg, HSDConfig::Behavior& behavior, uint32_t& color, 
+                                      int* colorMapIndex) const {
+    int index(m_config->getColorMapIndex(msg));    
+    if (colorMapIndex)
+        *colorMapIndex = index;
+    if (index != -1) {
+        behavior = m_config->getLedBehavior(index);
+        color = m_config->getLedColor(index);
+        return true;
+    }
+    if (msg.length() > 3 && msg[0] == '#') { // allow MQTT broker to directly set LED color with HEX strings
+        behavior = HSDConfig::Behavior::On;
+        color = m_config->string2hex(msg);
+        return true;
+    }
+    behavior = HSDConfig::Behavior::Off;
+    color = LED_COLOR_NONE;
+    return false;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HomeStatusDisplay::updateDeviceTables() {
+    bool devicesChanged = m_deviceTablesVersion != m_config->getDeviceMapVersion();
+    if (!devicesChanged && m_journalColorsVersion == m_config->getColorMapVersion())
+        return;
+    if (devicesChanged)
+        m_debouncer.reset(m_config->getDeviceMap().size());
+
+    // journal records refer to rows, they are moved to the rows with the same name, the journal on flash was 
+    // written with the configuration read at start
+    if (m_journalColorsVersion == 0) {
+        m_journal.reset(m_config->getDeviceMap().size());
     } else {
-        Logger.log("No LED defined for device %s, ignoring it", device.c_str());
+        vector<uint8_t> devices;
+        for (const String& device : m_journalDevices) {
+            int index = m_config->getDeviceIndex(device);
+            devices.push_back(index >= 0 && index < HSD_JOURNAL_INDEX_OTHER ? index : HSD_JOURNAL_INDEX_NONE);
+        }
+        vector<uint8_t> colors;
+        for (const String& msg : m_journalColors) {
+            int index = m_config->getColorMapIndex(msg);
+            colors.push_back(index >= 0 && index < HSD_JOURNAL_INDEX_OTHER ? index : HSD_JOURNAL_INDEX_OTHER);
+        }
+        m_journal.remap(devices, m_config->getDeviceMap().size(), colors);
+    }
+    m_journalDevices.clear();
+    for (const HSDConfig::DeviceMapping* mapping : m_config->getDeviceMap())
+        m_journalDevices.push_back(mapping->device);
+    m_journalColors.clear();
+    for (const HSDConfig::ColorMapping* mapping : m_config->getColorMap())
+        m_journalColors.push_back(mapping->msg);
+    m_deviceTablesVersion = m_config->getDeviceMapVersion();
+    m_journalColorsVersion = m_config->getColorMapVersion();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HomeStatusDisplay::checkDebounce() {
+    size_t device;
+    HSDConfig::Behavior behavior;
+    uint32_t color;
+    uint8_t journalIndex;
+    updateDeviceTables();
+    while (m_debouncer.poll(millis(), device, behavior, color, journalIndex)) {
+        recordStatus(device, journalIndex);
+        m_leds->set(m_config->getDeviceMap()[device]->ledNumber, behavior, color);
+        Logger.log("Set LED number %u of device %s after debounce", m_config->getDeviceMap()[device]->ledNumber, 
+                   m_config->getDeviceMap()[device]->device.c_str());
     }
-    return update;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HomeStatusDisplay::checkRules() {
+    if (m_rules.getSource() != m_config->getRules())
+        m_rules.compile(m_config->getRules());
+    if (!m_rules.isDirty() || m_mqttHandler->isSyncing()) // evaluated once all retained statuses are known
+        return;
+    
+    m_rules.evaluate([this](uint8_t led, const String& message) {
+        HSDConfig::Behavior behavior;
+        uint32_t color;
+        resolveStatus(message, behavior, color);
+        Logger.log("Rule for LED number %u results in %s", led, message.c_str());
+        m_leds->set(led, behavior, color);
+    });
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HomeStatusDisplay::checkLedMirror() {
+    // all changes within the interval are published with one snapshot
+    if (!m_config->getMqttLedMirror() || m_leds->getStateVersion() == m_ledMirrorVersion || 
+        millis() - m_ledMirrorLast < LED_MIRROR_MILLIS || m_mqttHandler->isSyncing())
+        return;
+    
+    m_ledMirrorLast = millis();
+    uint32_t version = m_leds->getStateVersion();
+    if (m_mqttHandler->publishRetained(m_config->getMqttOutTopic("leds"), m_leds->printStateLength(), 
+                                       [this](Print& out) { m_leds->printState(out); }))
+        m_ledMirrorVersion = version;
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
 
 void HomeStatusDisplay::checkMqttConnections() {
     static bool lastMqttConnectionState = false;
+    static bool lastMqttSyncState = false;
     
     if (!lastMqttConnectionState && m_mqttHandler->connected()) {
         lastMqttConnectionState = true;
         m_webServer->updateStatusEntry("mqttStatus", "connected");
-        m_leds->clear();
+        char buffer[48];
+        snprintf(buffer, 48, "%u (last %lu ms, max %lu ms)", m_mqttHandler->getConnectAttempts(), 
+                 m_mqttHandler->getConnectDurationLast(), m_mqttHandler->getConnectDurationMax());
+        m_webServer->updateStatusEntry("mqttConnect", buffer);
+        // a resumed session only delivers the changes, so the statuses shown before the disconnect are needed
+        if (m_mqttHandler->isSessionResumed() && m_leds->restoreState()) {
+            Logger.log("Session resumed, showing the statuses from before the disconnect");
+        } else {
+            m_leds->clear();
+            m_rules.invalidate();
+            if (m_mqttHandler->isSessionResumed())
+                m_mqttHandler->resubscribe(); // nothing to restore, the retained statuses are sent again
+        }
     } else if (lastMqttConnectionState && !m_mqttHandler->connected()) {
         lastMqttConnectionState = false;
         m_webServer->updateStatusEntry("mqttStatus", "disconnected");
+        m_leds->saveState();
         m_leds->setAllOn(LED_COLOR_YELLOW);
     }
+    
+    if (!lastMqttSyncState && m_mqttHandler->isSyncing()) {
+        lastMqttSyncState = true;
+        m_leds->holdFrame(true);
+    } else if (lastMqttSyncState && !m_mqttHandler->isSyncing()) {
+        lastMqttSyncState = false;
+        m_leds->holdFrame(false);
+        m_rules.invalidate(); // rule results overwrite the statuses of their LEDs received during the sync
+        char buffer[48];
+        snprintf(buffer, 48, "%u messages in %lu ms", m_mqttHandler->getSyncMessages(), m_mqttHandler->getSyncDuration());
+        m_webServer->updateStatusEntry("mqttSync", buffer);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void HomeStatusDisplay::writeMetrics(HSDMetricsWriter& metrics) const {
+    static const char* labels[] = { "source=\"mqtt\"", "source=\"http\"", "source=\"udp\"" };
+    metrics.addMetric("hsd_status_entries_total", "counter", "Status entries received");
+    for (int idx = 0; idx < static_cast<int>(Source::__Last); idx++)
+        metrics.addSample("hsd_status_entries_total", m_sourceMessages[idx], labels[idx]);
+    metrics.addGauge("hsd_journal_records", "Records in the status journal", m_journal.getSize());
+    metrics.addCounter("hsd_journal_dropped_total", "Journal records lost", m_journal.getDrops());
+    metrics.addGauge("hsd_rules", "Compiled rules", m_rules.getRuleCount());
+    metrics.addCounter("hsd_rule_evaluations_total", "Rule evaluations", m_rules.getEvaluations());
+    metrics.addGauge("hsd_loop_max_seconds", "Longest loop since the last status update (at most a minute ago)", 
+                     m_loopMaxMicros / 1000000.0);
+#ifdef HSD_SENSOR_ENABLED
+    if (m_sensor)
+        m_sensor->writeMetrics(metrics);
+#endif
 }
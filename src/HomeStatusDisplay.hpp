@@ -1,12 +1,19 @@
 #ifndef HOMESTATUSDISPLAY_H
 #define HOMESTATUSDISPLAY_H
 
+#include "HSDBulkParser.hpp"
 #include "HSDConfig.hpp"
+#include "HSDDebouncer.hpp"
+#include "HSDJournal.hpp"
+#include "HSDJsonPath.hpp"
+#include "HSDRules.hpp"
 #include "HSDWifi.hpp"
 #include "HSDWebserver.hpp"
 #include "HSDLeds.hpp"
 #include "HSDMqtt.hpp"
 
+#include <WiFiUdp.h>
+
 #ifdef HSD_CLOCK_ENABLED
 #include "HSDClock.hpp"
 #endif
@@ -25,28 +32,76 @@ public:
     void work();
   
 private:
+    enum class Source : uint8_t {
+        Mqtt = 0,
+        Http,
+        Udp,
+        __Last
+    };
+
+    void   beginBulkStatus(Source source);
+    bool   beginStream(const char* topic, uint32_t length);
     void   calcUptime();
+    void   checkDebounce();
+    void   checkLedMirror();
     void   checkMqttConnections();
-    String getDevice(const String& statusTopic) const;
-    bool   handleStatus(const String& device, const String& msg);
+    void   checkRules();
+    void   checkUdp();
+    uint32_t getTime(bool& uptime) const;
+    bool   endBulkStatus(bool complete);
+    void   endStream(bool complete);
+    void   feedBulkStatus(const char* data, size_t length);
+    void   feedStream(const uint8_t* data, size_t length);
+    bool   getDevice(const String& topic, String& device) const;
+    bool   handleBulkStatus(const char* payload, unsigned int length, Source source);
+    bool   handlePathStatus(const String& device, const String& path, const char* payload, unsigned int length, 
+                            bool verbose);
+    bool   handleStatus(const String& device, const String& msg, bool verbose = true);
+    void   updateDeviceTables();
+    void   writeMetrics(HSDMetricsWriter& metrics) const;
 #ifdef MQTT_TEST_TOPIC
     void   handleTest(const String& msg);
 #endif    
-    bool   isStatusTopic(const String& topic) const;
+    bool   isBulkDevice(const String& device) const;
     void   mqttCallback(char* topic, byte* payload, unsigned int length);
+    void   recordStatus(size_t device, uint8_t colorIndex);
+    bool   resolveStatus(const String& msg, HSDConfig::Behavior& behavior, uint32_t& color, 
+                         int* colorMapIndex = nullptr) const;
 
 #if defined HSD_BLUETOOTH_ENABLED && defined ARDUINO_ARCH_ESP32
     HSDBluetooth* m_bluetooth;
 #endif   
+    HSDBulkParser* m_bulkParser;  // only exists while a bulk status message is parsed
+    size_t         m_bulkBytes;
+    unsigned int   m_bulkEntries;
+    Source         m_bulkSource;
+    unsigned int   m_bulkUpdates;
 #ifdef HSD_CLOCK_ENABLED
     HSDClock*     m_clock;
 #endif
     HSDConfig*    m_config;
+    HSDDebouncer  m_debouncer;
+    uint32_t      m_deviceTablesVersion; // device map version the debouncer and journal tables were built for
+    HSDJournal    m_journal;
+    vector<String> m_journalColors;      // messages and devices the journal indexes refer to
+    uint32_t      m_journalColorsVersion; // color map version of m_journalColors, 0 before the first update
+    vector<String> m_journalDevices;
+    HSDJsonPath*  m_jsonPath;     // only exists while a large message with a JSON path is scanned
+    String        m_jsonPathDevice;
+    String        m_jsonPathPath;
+    unsigned long m_ledMirrorLast;
+    uint32_t      m_ledMirrorVersion; // LED state version last published
     HSDLeds*      m_leds;
+    unsigned long m_loopCount;     // loops since the last status update
+    unsigned long m_loopMaxMicros; // longest loop since the last status update
+    unsigned long m_loopMicros;    // sum over these loops
     HSDMqtt*      m_mqttHandler;
+    HSDRules      m_rules;
 #ifdef HSD_SENSOR_ENABLED
     HSDSensor*    m_sensor;
 #endif
+    unsigned long m_sourceMessages[static_cast<int>(Source::__Last)]; // status entries received per source
+    WiFiUDP*      m_udp;
     HSDWebserver* m_webServer;
     HSDWifi*      m_wifi;
 };